@@ -0,0 +1,34 @@
+-- Compares a full depth first walk using Nodes against one using node handles
+--
+-- Usage: lua bench/node_handles.lua [number of functions in generated source]
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local function_count = tonumber(arg and arg[1]) or 20000
+local _, parser = util.load_c_parser()
+local tree = assert(parser:parse_string(util.generate_c_source(function_count)))
+
+util.header("node handles")
+
+local function walk_nodes(node)
+	local n = 1
+	for child in node:children() do
+		n = n + walk_nodes(child)
+	end
+	return n
+end
+
+local function walk_handles(h)
+	local n = 1
+	local child = tree:handle_child(h, 0)
+	while child do
+		n = n + walk_handles(child)
+		child = tree:handle_next_sibling(child)
+	end
+	return n
+end
+
+util.measure("Node", "nodes visited", "nodes", walk_nodes, tree:root())
+util.measure("handle", "nodes visited", "nodes", walk_handles, tree:root_handle())
+tree:release_handles()
@@ -0,0 +1,52 @@
+-- Measures node creation throughput and the cost of a full garbage collection
+-- while many nodes are alive.
+--
+-- Each node keeps its tree alive, so this mostly measures the lifetime
+-- binding backend (see csrc/object.h). To compare uservalues against the weak
+-- object table, run it under Lua 5.3 or later (uservalues need 5.3) once with
+-- each backend built:
+--
+--    luarocks make rockspec/ltreesitter-dev-1.rockspec CFLAGS="-O2 -fPIC -DLTREESITTER_USE_USERVALUES"
+--    lua bench/node_lifetimes.lua
+--    luarocks make rockspec/ltreesitter-dev-1.rockspec CFLAGS="-O2 -fPIC -DLTREESITTER_USE_OBJECT_TABLE"
+--    lua bench/node_lifetimes.lua
+--
+-- Usage: lua bench/node_lifetimes.lua [number of functions in generated source]
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local function_count = tonumber(arg and arg[1]) or 20000
+local _, parser = util.load_c_parser()
+local tree = assert(parser:parse_string(util.generate_c_source(function_count)))
+local root = tree:root()
+
+util.header("node lifetimes")
+
+local function walk(node, out)
+	out[#out + 1] = node
+	for child in node:children() do
+		walk(child, out)
+	end
+	return out
+end
+
+collectgarbage("collect")
+local seconds, nodes = util.time(walk, root, {})
+util.report("nodes created", #nodes, "nodes")
+util.report("node creation throughput", #nodes / seconds / 1e6, "Mnodes/s")
+
+local node_count = #nodes
+local gc_seconds = util.time(collectgarbage, "collect")
+util.report("full gc with all nodes alive", gc_seconds * 1e3, "ms")
+
+nodes = nil
+gc_seconds = util.time(collectgarbage, "collect")
+util.report("full gc collecting all nodes", gc_seconds * 1e3, "ms")
+
+local rounds = 5
+local churn_start = os.clock()
+for _ = 1, rounds do
+	walk(root, {})
+end
+util.report("walk + garbage throughput", rounds * node_count / (os.clock() - churn_start) / 1e6, "Mnodes/s")
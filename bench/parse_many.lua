@@ -0,0 +1,67 @@
+-- Parses a corpus of C files with Language:parse_many using an increasing number of threads,
+-- compared to calling Parser:parse_string on each file
+--
+-- Usage: lua bench/parse_many.lua [files...]
+--    e.g. lua bench/parse_many.lua ~/tree-sitter-c/src/*.c
+-- defaults to ltreesitter's own sources (csrc/*.c)
+-- the corpus is repeated so that there is enough work to spread over the threads
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local paths = {}
+for i = 1, arg and #arg or 0 do
+	paths[i] = arg[i]
+end
+if #paths == 0 then
+	local ls = assert(io.popen("ls csrc/*.c"))
+	for line in ls:lines() do
+		paths[#paths + 1] = line
+	end
+	ls:close()
+end
+
+local c, parser = util.load_c_parser()
+
+local files = {}
+local bytes = 0
+for _, path in ipairs(paths) do
+	local f = assert(io.open(path, "rb"))
+	files[#files + 1] = f:read("*a")
+	f:close()
+	bytes = bytes + #files[#files]
+end
+
+local sources = {}
+local repeats = math.max(1, math.ceil(32 * 1024 * 1024 / math.max(bytes, 1)))
+for _ = 1, repeats do
+	for _, src in ipairs(files) do
+		sources[#sources + 1] = src
+	end
+end
+local total_mb = bytes * repeats / (1024 * 1024)
+
+util.header("parse many")
+util.report("files", #sources, "")
+util.report("total size", total_mb, "MiB")
+
+local function measure(name, f)
+	collectgarbage("collect")
+	local seconds = util.wall_time(f)
+	util.report(name .. " total", seconds * 1e3, "ms")
+	util.report(name .. " throughput", total_mb / seconds, "MiB/s")
+end
+
+measure("Parser:parse_string loop", function()
+	local trees = {}
+	for i, src in ipairs(sources) do
+		trees[i] = parser:parse_string(src)
+	end
+	return trees
+end)
+
+for _, threads in ipairs { 1, 2, 4, 8, 16 } do
+	measure(("Language:parse_many (%d threads)"):format(threads), function()
+		return c:parse_many(sources, threads)
+	end)
+end
@@ -0,0 +1,60 @@
+-- Runs a small query on every function body of a generated source, which is
+-- dominated by the cost of setting up a query cursor for each run
+--
+-- Usage: lua bench/query_cursor_pool.lua [number of functions in generated source]
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local function_count = tonumber(arg and arg[1]) or 10000
+local c, parser = util.load_c_parser()
+local tree = assert(parser:parse_string(util.generate_c_source(function_count)))
+
+util.header("query cursor pool")
+
+local bodies = {}
+for m in c:query[[ (function_definition body: (compound_statement) @body) ]]:match(tree:root()) do
+	bodies[#bodies + 1] = m.captures.body
+end
+
+local query = c:query[[ (return_statement (identifier) @returned) ]]
+
+local function run_exec()
+	local predicates = {}
+	for _, body in ipairs(bodies) do
+		query:exec(body, predicates)
+	end
+	return #bodies
+end
+
+local function run_match()
+	local matches = 0
+	for _, body in ipairs(bodies) do
+		for _ in query:match(body) do
+			matches = matches + 1
+		end
+	end
+	return matches
+end
+
+local function run_capture()
+	local captures = 0
+	for _, body in ipairs(bodies) do
+		for _ in query:capture(body) do
+			captures = captures + 1
+		end
+	end
+	return captures
+end
+
+local function measure(name, f)
+	collectgarbage("collect")
+	local seconds = util.time(f)
+	util.report(name .. " total", seconds * 1e3, "ms")
+	util.report(name .. " per query", seconds * 1e6 / #bodies, "us")
+end
+
+util.report("queries per run", #bodies, "")
+measure("Query:exec", run_exec)
+measure("Query:match", run_match)
+measure("Query:capture", run_capture)
@@ -0,0 +1,33 @@
+-- Compares visiting the nodes of one type with Tree:walk against a recursive
+-- walk over Node:children in Lua
+--
+-- Usage: lua bench/tree_walk.lua [number of functions in generated source]
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local function_count = tonumber(arg and arg[1]) or 20000
+local _, parser = util.load_c_parser()
+local tree = assert(parser:parse_string(util.generate_c_source(function_count)))
+
+util.header("tree walk")
+
+local function lua_walk(node)
+	local n = 0
+	if node:type() == "if_statement" then
+		n = 1
+	end
+	for child in node:children() do
+		n = n + lua_walk(child)
+	end
+	return n
+end
+
+local function native_walk(t)
+	local n = 0
+	t:walk{ if_statement = function() n = n + 1 end }
+	return n
+end
+
+util.measure("Node:children recursion", "nodes handled", "nodes", lua_walk, tree:root())
+util.measure("Tree:walk", "nodes handled", "nodes", native_walk, tree)
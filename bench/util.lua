@@ -0,0 +1,72 @@
+-- Shared helpers for the benchmarks in this directory
+--
+-- Run benchmarks from the repository root, e.g.
+--    lua bench/node_lifetimes.lua
+-- with ltreesitter and a C parser in your cpath (same setup as the test suite)
+
+local ts = require("ltreesitter")
+
+local util = {}
+
+function util.load_c_parser()
+	package.cpath = package.cpath .. ";" .. os.getenv "HOME" .. "/.tree-sitter/bin/?.so"
+	local ok, c_language = pcall(ts.require, "c")
+	if not ok then
+		error("The ltreesitter benchmarks require a C parser in your LUA_CPATH\n\n" .. tostring(c_language))
+	end
+	return c_language, c_language:parser()
+end
+
+-- Generate a C translation unit with `n` small functions
+function util.generate_c_source(n)
+	local buf = {}
+	for i = 1, n do
+		buf[#buf + 1] = ("static int function_%d(int a, int b) {\n"
+			.. "\tint result = a * %d + b;\n"
+			.. "\tif (result > 100) { return result - 1; }\n"
+			.. "\treturn result;\n"
+			.. "}\n"):format(i, i)
+	end
+	return table.concat(buf)
+end
+
+-- Returns the cpu time in seconds it took to run `f(...)` and its first return value
+function util.time(f, ...)
+	local start = os.clock()
+	local result = f(...)
+	return os.clock() - start, result
+end
+
+-- Like util.time, but measures wall clock time, for benchmarks where work is spread over multiple threads
+-- Uses luasocket when available, otherwise falls back on os.time's one second resolution
+local ok, socket = pcall(require, "socket")
+local wall_clock = ok and socket.gettime or os.time
+function util.wall_time(f, ...)
+	local start = wall_clock()
+	local result = f(...)
+	return wall_clock() - start, result
+end
+
+function util.report(name, value, unit)
+	io.write(("%-48s %14.3f %s\n"):format(name, value, unit or ""))
+end
+
+-- Reports the count `f(...)` returns (as `counted`, in `unit`s), the cpu time it took, and the memory
+-- it allocated, with the collector stopped so that the allocations aren't hidden by collections
+function util.measure(name, counted, unit, f, ...)
+	collectgarbage("collect")
+	collectgarbage("stop")
+	local kb_before = collectgarbage("count")
+	local seconds, count = util.time(f, ...)
+	local kb_after = collectgarbage("count")
+	collectgarbage("restart")
+	util.report(name .. " " .. counted, count, unit)
+	util.report(name .. " time", seconds * 1e3, "ms")
+	util.report(name .. " gc memory allocated", kb_after - kb_before, "KiB")
+end
+
+function util.header(title)
+	io.write(("== %s (%s, ltreesitter %s) ==\n"):format(title, _VERSION, ts.version))
+end
+
+return util
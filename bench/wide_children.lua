@@ -0,0 +1,66 @@
+-- Iterates over the children of a node with 50k children, comparing indexing
+-- with Node:named_child against the cursor based iterators (with and without a
+-- filter checked in C) and Node:children_array
+--
+-- Usage: lua bench/wide_children.lua [number of children]
+
+package.path = "./?.lua;" .. package.path
+local util = require("bench.util")
+
+local child_count = tonumber(arg and arg[1]) or 50000
+local language, parser = util.load_c_parser()
+
+-- alternate declarations and comments so that filtering has something to skip
+local buf = {}
+for i = 1, child_count do
+	buf[i] = i % 2 == 0 and ("int x%d;"):format(i) or ("// comment %d"):format(i)
+end
+local root = assert(parser:parse_string(table.concat(buf, "\n"))):root()
+assert(root:child_count() == child_count)
+
+util.header("wide children")
+
+local function by_index(node)
+	local n = 0
+	for i = 0, node:named_child_count() - 1 do
+		if node:named_child(i):type() == "declaration" then
+			n = n + 1
+		end
+	end
+	return n
+end
+
+local function named_children(node)
+	local n = 0
+	for child in node:named_children() do
+		if child:type() == "declaration" then
+			n = n + 1
+		end
+	end
+	return n
+end
+
+local declarations = language:symbol_set("declaration")
+local function filtered(node)
+	local n = 0
+	for _ in node:children(declarations) do
+		n = n + 1
+	end
+	return n
+end
+
+local function array(node)
+	local n = 0
+	local children = node:children_array(true)
+	for i = 1, #children do
+		if children[i]:type() == "declaration" then
+			n = n + 1
+		end
+	end
+	return n
+end
+
+util.measure("Node:named_child(i)", "declarations found", "declarations", by_index, root)
+util.measure("Node:named_children", "declarations found", "declarations", named_children, root)
+util.measure("Node:children(SymbolSet)", "declarations found", "declarations", filtered, root)
+util.measure("Node:children_array", "declarations found", "declarations", array, root)
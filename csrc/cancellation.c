@@ -0,0 +1,135 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L // clock_gettime, CLOCK_MONOTONIC
+#endif
+
+#include <lauxlib.h>
+#include <lua.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "cancellation.h"
+#include "luautils.h"
+#include "threads.h"
+
+/* @teal-export cancellation_flag: function(): CancellationFlag [[
+   Create a new flag that can be given to the <code>cancellation_flag</code> field of a <code>ParseOptions</code> to cancel a parse once it is set.
+
+   The flag is checked without calling into Lua, so a flag can be shared with a parse running on another thread (i.e. from <code>Parser.parse_string_async</code>).
+   From C, the flag's userdata is a single <code>uint32_t</code> that can be set atomically to a non-zero value, e.g. from a signal handler.
+]] */
+int cancellation_flag_new(lua_State *L) {
+	CancellationFlag *const flag = lua_newuserdata(L, sizeof(CancellationFlag));
+	atomic_store_u32(&flag->is_set, 0);
+	setmetatable(L, LTREESITTER_CANCELLATION_FLAG_METATABLE_NAME);
+	return 1;
+}
+
+/* @teal-export CancellationFlag.set: function(CancellationFlag) [[
+   Set the flag, cancelling any parse it was given to
+]] */
+static int cancellation_flag_set(lua_State *L) {
+	CancellationFlag *const flag = cancellation_flag_assert(L, 1);
+	atomic_store_u32(&flag->is_set, 1);
+	return 0;
+}
+
+/* @teal-export CancellationFlag.reset: function(CancellationFlag) [[
+   Unset the flag so that it can be used for another parse
+]] */
+static int cancellation_flag_reset(lua_State *L) {
+	CancellationFlag *const flag = cancellation_flag_assert(L, 1);
+	atomic_store_u32(&flag->is_set, 0);
+	return 0;
+}
+
+/* @teal-export CancellationFlag.is_set: function(CancellationFlag): boolean [[
+   Check whether the flag has been set
+]] */
+static int cancellation_flag_is_set(lua_State *L) {
+	CancellationFlag *const flag = cancellation_flag_assert(L, 1);
+	lua_pushboolean(L, atomic_load_u32(&flag->is_set) != 0);
+	return 1;
+}
+
+static const luaL_Reg cancellation_flag_methods[] = {
+	{"set", cancellation_flag_set},
+	{"reset", cancellation_flag_reset},
+	{"is_set", cancellation_flag_is_set},
+	{NULL, NULL}};
+
+void cancellation_flag_init_metatable(lua_State *L) {
+	create_metatable(L, LTREESITTER_CANCELLATION_FLAG_METATABLE_NAME, (luaL_Reg[]){{NULL, NULL}}, cancellation_flag_methods);
+}
+
+ParseLimits parse_limits_from_options(lua_State *L, int options_idx) {
+	ParseLimits limits = {0};
+	if (lua_isnoneornil(L, options_idx)) {
+		lua_pushnil(L);
+		return limits;
+	}
+	options_idx = absindex(L, options_idx);
+	luaL_argcheck(L, lua_type(L, options_idx) == LUA_TTABLE, options_idx, "expected a table of parse options");
+
+	lua_getfield(L, options_idx, "timeout_micros"); // ?timeout
+	if (!lua_isnil(L, -1)) {
+		lua_Integer timeout;
+		if (!tointeger_exact(L, -1, &timeout) || timeout < 0)
+			luaL_error(L, "Expected timeout_micros to be a non-negative integer");
+		uint64_t const now = monotonic_microseconds();
+		// a timeout of 0 would otherwise mean no timeout, and a huge one saturates rather than wrapping into the past
+		limits.deadline_micros = (uint64_t)timeout >= UINT64_MAX - now
+			? UINT64_MAX
+			: now + (uint64_t)timeout + 1;
+	}
+	lua_pop(L, 1);
+
+	lua_getfield(L, options_idx, "cancellation_flag"); // ?flag
+	if (!lua_isnil(L, -1)) {
+		limits.flag_or_null = cancellation_flag_check(L, -1);
+		if (!limits.flag_or_null)
+			luaL_error(L, "Expected cancellation_flag to be a CancellationFlag, got %s", luaL_typename(L, -1));
+	}
+	return limits;
+}
+
+static bool flag_is_set(ParseLimits const *limits) {
+	return limits->flag_or_null
+		&& atomic_load_u32((uint32_t volatile *)&limits->flag_or_null->is_set) != 0;
+}
+
+bool parse_limits_exceeded(ParseLimits *limits) {
+	if (flag_is_set(limits))
+		limits->hit = PARSE_LIMIT_CANCELLED;
+	else if (limits->deadline_micros != 0 && monotonic_microseconds() >= limits->deadline_micros)
+		limits->hit = PARSE_LIMIT_TIMED_OUT;
+	return limits->hit != PARSE_LIMIT_NONE;
+}
+
+bool parse_limits_progress_callback(TSParseState *state) {
+	return parse_limits_exceeded(state->payload);
+}
+
+void parse_limits_push_reason(lua_State *L, ParseLimits const *limits) {
+	if (limits->hit == PARSE_LIMIT_CANCELLED)
+		lua_pushliteral(L, "cancelled");
+	else
+		lua_pushliteral(L, "timed out");
+}
+
+uint64_t monotonic_microseconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000
+		+ (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+#endif
+}
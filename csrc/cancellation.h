@@ -0,0 +1,61 @@
+#ifndef LTREESITTER_CANCELLATION_H
+#define LTREESITTER_CANCELLATION_H
+
+#include "types.h"
+#include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <tree_sitter/api.h>
+
+// A flag that cancels any parse it was given to once it is set
+//
+// This is just a u32 so that C code (another thread, a signal handler, etc.)
+// can set it with atomic_store_u32 from threads.h through the userdata's address
+typedef struct {
+	uint32_t volatile is_set;
+} CancellationFlag;
+
+def_check_assert(CancellationFlag, cancellation_flag, LTREESITTER_CANCELLATION_FLAG_METATABLE_NAME)
+
+// ( -- table )
+void cancellation_flag_init_metatable(lua_State *L);
+
+// ( -- CancellationFlag )
+int cancellation_flag_new(lua_State *L);
+
+// Limits on a parse that are checked natively from a progress callback rather
+// than by calling into Lua
+typedef enum {
+	PARSE_LIMIT_NONE,
+	PARSE_LIMIT_CANCELLED,
+	PARSE_LIMIT_TIMED_OUT,
+} ParseLimitHit;
+
+typedef struct {
+	CancellationFlag const *flag_or_null;
+	uint64_t deadline_micros; // 0 when there is no timeout
+	ParseLimitHit hit;        // the limit that stopped the parse, if any
+} ParseLimits;
+
+// ( [options_idx]=?ParseOptions | -- [options_idx]=?ParseOptions, ?CancellationFlag )
+// Reads `timeout_micros` and `cancellation_flag` from an options table. The
+// flag (or nil) is pushed so the caller can keep it alive for the parse
+ParseLimits parse_limits_from_options(lua_State *L, int options_idx);
+
+static inline bool parse_limits_active(ParseLimits const *limits) {
+	return limits->flag_or_null || limits->deadline_micros != 0;
+}
+
+// Whether a limit has been reached, recording which one in `hit`
+bool parse_limits_exceeded(ParseLimits *limits);
+
+// A progress callback whose payload is a ParseLimits
+bool parse_limits_progress_callback(TSParseState *state);
+
+// ( -- string )
+// Push the reason a parse was stopped by the limit in `hit`
+void parse_limits_push_reason(lua_State *L, ParseLimits const *limits);
+
+uint64_t monotonic_microseconds(void);
+
+#endif
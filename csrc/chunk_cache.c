@@ -0,0 +1,177 @@
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_cache.h"
+#include "luautils.h"
+
+// Readers tend to return small chunks (e.g. a line at a time), so adjacent
+// text is merged into one chunk up to this size rather than allocating each
+#define MAX_MERGED_CHUNK_LENGTH (64 * 1024)
+
+static int chunk_cache_gc(lua_State *L) {
+	ChunkCache *const cache = chunk_cache_assert(L, 1);
+	for (uint32_t i = 0; i < cache->count; ++i)
+		free(cache->chunks[i].data);
+	free(cache->chunks);
+	*cache = (ChunkCache){0};
+	return 0;
+}
+
+void chunk_cache_init_metatable(lua_State *L) {
+	static const luaL_Reg metamethods[] = {
+		{"__gc", chunk_cache_gc},
+		{NULL, NULL}};
+	create_metatable(L, LTREESITTER_CHUNK_CACHE_METATABLE_NAME, metamethods, NULL);
+	lua_pop(L, 1);
+}
+
+ChunkCache *chunk_cache_push(lua_State *L, size_t max_bytes) {
+	ChunkCache *const cache = lua_newuserdata(L, sizeof(ChunkCache));
+	*cache = (ChunkCache){.max_bytes = max_bytes};
+	setmetatable(L, LTREESITTER_CHUNK_CACHE_METATABLE_NAME);
+	return cache;
+}
+
+static inline uint32_t chunk_end(CachedChunk const *c) {
+	return c->start + c->length;
+}
+
+// index of the first chunk that ends after `byte`
+static uint32_t first_chunk_ending_after(ChunkCache const *cache, uint32_t byte) {
+	uint32_t lo = 0, hi = cache->count;
+	while (lo < hi) {
+		uint32_t const mid = lo + (hi - lo) / 2;
+		if (chunk_end(&cache->chunks[mid]) <= byte)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Retain text that isn't retained yet as chunk `i`, or as part of chunk `i - 1` if it directly follows it
+static bool retain(ChunkCache *cache, uint32_t i, uint32_t start, char const *text, uint32_t length) {
+	if (i > 0) {
+		CachedChunk *const prev = &cache->chunks[i - 1];
+		if (chunk_end(prev) == start && prev->length + length <= MAX_MERGED_CHUNK_LENGTH) {
+			if (prev->capacity - prev->length < length) {
+				uint32_t new_cap = prev->capacity * 2;
+				if (new_cap < prev->length + length)
+					new_cap = prev->length + length;
+				if (new_cap > MAX_MERGED_CHUNK_LENGTH)
+					new_cap = MAX_MERGED_CHUNK_LENGTH;
+				char *const data = realloc(prev->data, new_cap);
+				if (!data)
+					return false;
+				prev->data = data;
+				prev->capacity = new_cap;
+			}
+			memcpy(prev->data + prev->length, text, length);
+			prev->length += length;
+			cache->bytes += length;
+			return true;
+		}
+	}
+
+	if (cache->count >= cache->capacity) {
+		uint32_t const new_cap = cache->capacity ? cache->capacity * 2 : 16;
+		CachedChunk *const chunks = realloc(cache->chunks, sizeof(CachedChunk) * new_cap);
+		if (!chunks)
+			return false;
+		cache->chunks = chunks;
+		cache->capacity = new_cap;
+	}
+	char *const data = malloc(length);
+	if (!data)
+		return false;
+	memcpy(data, text, length);
+	memmove(&cache->chunks[i + 1], &cache->chunks[i], sizeof(CachedChunk) * (cache->count - i));
+	cache->chunks[i] = (CachedChunk){
+		.start = start,
+		.length = length,
+		.capacity = length,
+		.data = data,
+	};
+	cache->count += 1;
+	cache->bytes += length;
+	return true;
+}
+
+static void evict(ChunkCache *cache) {
+	uint32_t n = 0;
+	while (n < cache->count && cache->bytes > cache->max_bytes) {
+		cache->bytes -= cache->chunks[n].length;
+		free(cache->chunks[n].data);
+		n += 1;
+	}
+	if (n == 0)
+		return;
+	memmove(&cache->chunks[0], &cache->chunks[n], sizeof(CachedChunk) * (cache->count - n));
+	cache->count -= n;
+}
+
+void chunk_cache_add(ChunkCache *cache, uint32_t start, char const *data, uint32_t length) {
+	if (length > UINT32_MAX - start)
+		length = UINT32_MAX - start;
+	uint32_t const end = start + length;
+
+	// tree-sitter may ask for the same text more than once, so only retain the gaps
+	uint32_t pos = start;
+	while (pos < end) {
+		uint32_t const i = first_chunk_ending_after(cache, pos);
+		if (i < cache->count && cache->chunks[i].start <= pos) {
+			pos = chunk_end(&cache->chunks[i]);
+			continue;
+		}
+		uint32_t const gap_end = i < cache->count && cache->chunks[i].start < end
+			? cache->chunks[i].start
+			: end;
+		if (!retain(cache, i, pos, data + (pos - start), gap_end - pos))
+			break;
+		pos = gap_end;
+	}
+
+	evict(cache);
+}
+
+bool chunk_cache_get(ChunkCache const *cache, uint32_t start, uint32_t end, MaybeOwnedString *out) {
+	if (start >= end) {
+		*out = (MaybeOwnedString){.data = "", .length = 0, .owned = false};
+		return true;
+	}
+
+	uint32_t const first = first_chunk_ending_after(cache, start);
+	if (first >= cache->count || cache->chunks[first].start > start)
+		return false;
+
+	CachedChunk const *const c = &cache->chunks[first];
+	if (end <= chunk_end(c)) {
+		*out = (MaybeOwnedString){.data = c->data + (start - c->start), .length = end - start, .owned = false};
+		return true;
+	}
+
+	// only usable if the chunks covering the range are contiguous
+	uint32_t last = first;
+	while (chunk_end(&cache->chunks[last]) < end) {
+		if (last + 1 >= cache->count || cache->chunks[last + 1].start != chunk_end(&cache->chunks[last]))
+			return false;
+		last += 1;
+	}
+
+	char *const data = malloc(end - start);
+	if (!data)
+		return false;
+	uint32_t written = 0;
+	for (uint32_t i = first; i <= last; ++i) {
+		CachedChunk const *const chunk = &cache->chunks[i];
+		uint32_t const from = i == first ? start - chunk->start : 0;
+		uint32_t const to = i == last ? end - chunk->start : chunk->length;
+		memcpy(data + written, chunk->data + from, to - from);
+		written += to - from;
+	}
+	*out = (MaybeOwnedString){.data = data, .length = written, .owned = true};
+	return true;
+}
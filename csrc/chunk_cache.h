@@ -0,0 +1,44 @@
+#ifndef LTREESITTER_CHUNK_CACHE_H
+#define LTREESITTER_CHUNK_CACHE_H
+
+#include "luautils.h"
+#include "types.h"
+#include <lua.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The text a reader function returned while parsing, retained so that node
+// sources can be copied out of it rather than calling the reader again
+//
+// A tree parsed with a chunk cache keeps the cache in place of its reader, and
+// the cache keeps the reader for anything it doesn't have.
+
+typedef struct {
+	uint32_t start, length, capacity;
+	char *data;
+} CachedChunk;
+
+typedef struct {
+	CachedChunk *chunks; // sorted by start and never overlapping
+	uint32_t count, capacity;
+	size_t bytes, max_bytes;
+} ChunkCache;
+
+def_check_assert(ChunkCache, chunk_cache, LTREESITTER_CHUNK_CACHE_METATABLE_NAME)
+
+// ( -- )
+void chunk_cache_init_metatable(lua_State *L);
+
+// ( -- ChunkCache )
+ChunkCache *chunk_cache_push(lua_State *L, size_t max_bytes);
+
+// Retain the text read at `start`, skipping anything already retained
+// Once more than `max_bytes` are retained, the text at the start of the document is dropped first
+// This is best effort, so text that can't be allocated is just not retained
+void chunk_cache_add(ChunkCache *, uint32_t start, char const *data, uint32_t length);
+
+// Get the text from `start` to `end` if all of it was retained, borrowed from
+// the cache when it is all in one chunk, otherwise copied
+bool chunk_cache_get(ChunkCache const *, uint32_t start, uint32_t end, MaybeOwnedString *out);
+
+#endif
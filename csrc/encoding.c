@@ -0,0 +1,141 @@
+#include <string.h>
+
+#include "encoding.h"
+
+TSPoint advance_point(TSPoint point, char const *text, uint32_t length, TSInputEncoding encoding) {
+	switch (encoding) {
+	case TSInputEncodingUTF16LE:
+	case TSInputEncodingUTF16BE: {
+		uint32_t const newline_offset = encoding == TSInputEncodingUTF16LE ? 0 : 1;
+		uint32_t i = 0;
+		for (; i + 1 < length; i += 2) {
+			if (text[i + newline_offset] == '\n' && text[i + 1 - newline_offset] == 0) {
+				point.row += 1;
+				point.column = 0;
+			} else {
+				point.column += 2;
+			}
+		}
+		point.column += length - i;
+		break;
+	}
+	default:
+		for (uint32_t i = 0; i < length; ++i) {
+			if (text[i] == '\n') {
+				point.row += 1;
+				point.column = 0;
+			} else {
+				point.column += 1;
+			}
+		}
+		break;
+	}
+	return point;
+}
+
+static inline uint32_t read_unit(unsigned char const *p, bool big_endian) {
+	return big_endian
+		? (uint32_t)p[0] << 8 | p[1]
+		: (uint32_t)p[1] << 8 | p[0];
+}
+
+// Decode the code point at `*i`, advancing `*i` past it
+static uint32_t next_code_point(unsigned char const *text, uint32_t length, uint32_t *i, bool big_endian) {
+	if (*i + 1 >= length) {
+		*i = length;
+		return 0xFFFD;
+	}
+	uint32_t const unit = read_unit(text + *i, big_endian);
+	*i += 2;
+	if (unit < 0xD800 || unit > 0xDFFF)
+		return unit;
+	if (unit <= 0xDBFF && *i + 1 < length) {
+		uint32_t const low = read_unit(text + *i, big_endian);
+		if (low >= 0xDC00 && low <= 0xDFFF) {
+			*i += 2;
+			return 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+		}
+	}
+	return 0xFFFD;
+}
+
+static uint32_t encode_utf8(uint32_t cp, unsigned char *out) {
+	if (cp < 0x80) {
+		out[0] = (unsigned char)cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		out[0] = (unsigned char)(0xC0 | cp >> 6);
+		out[1] = (unsigned char)(0x80 | (cp & 0x3F));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		out[0] = (unsigned char)(0xE0 | cp >> 12);
+		out[1] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+		out[2] = (unsigned char)(0x80 | (cp & 0x3F));
+		return 3;
+	}
+	out[0] = (unsigned char)(0xF0 | cp >> 18);
+	out[1] = (unsigned char)(0x80 | (cp >> 12 & 0x3F));
+	out[2] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+	out[3] = (unsigned char)(0x80 | (cp & 0x3F));
+	return 4;
+}
+
+// Mask of the bits that must be clear in 8 bytes of UTF-16 for them to be 4 ascii code units
+// Built from bytes so it doesn't depend on the host's endianness
+static uint64_t ascii_mask(bool big_endian) {
+	static unsigned char const le[8] = {0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF};
+	static unsigned char const be[8] = {0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80};
+	uint64_t mask;
+	memcpy(&mask, big_endian ? be : le, sizeof mask);
+	return mask;
+}
+
+bool utf16_to_utf8(StringBuilder *out, char const *text, uint32_t length, bool big_endian) {
+	// each 2 byte unit is at most 3 bytes of utf-8, and a 4 byte surrogate pair is 4 bytes
+	if (!sb_ensure_cap(out, (size_t)out->length + (size_t)length / 2 * 3 + 3))
+		return false;
+
+	unsigned char const *const src = (unsigned char const *)text;
+	unsigned char *dst = (unsigned char *)out->data + out->length;
+	uint64_t const mask = ascii_mask(big_endian);
+	uint32_t const low_byte = big_endian ? 1 : 0;
+
+	uint32_t i = 0;
+	while (i < length) {
+		// mostly ascii source code is the common case, so take 4 units at a time while we can
+		while (i + 8 <= length) {
+			uint64_t word;
+			memcpy(&word, src + i, sizeof word);
+			if (word & mask)
+				break;
+			dst[0] = src[i + low_byte];
+			dst[1] = src[i + 2 + low_byte];
+			dst[2] = src[i + 4 + low_byte];
+			dst[3] = src[i + 6 + low_byte];
+			dst += 4;
+			i += 8;
+		}
+		if (i >= length)
+			break;
+		dst += encode_utf8(next_code_point(src, length, &i, big_endian), dst);
+	}
+
+	out->length = (uint32_t)(dst - (unsigned char *)out->data);
+	return true;
+}
+
+bool utf16_eq_utf8(char const *utf16, uint32_t utf16_length, bool big_endian, char const *utf8, uint32_t utf8_length) {
+	unsigned char const *const src = (unsigned char const *)utf16;
+	unsigned char const *const expected = (unsigned char const *)utf8;
+	uint32_t i = 0, j = 0;
+	while (i < utf16_length) {
+		unsigned char encoded[4];
+		uint32_t const n = encode_utf8(next_code_point(src, utf16_length, &i, big_endian), encoded);
+		if (utf8_length - j < n || memcmp(expected + j, encoded, n) != 0)
+			return false;
+		j += n;
+	}
+	return j == utf8_length;
+}
@@ -0,0 +1,28 @@
+#ifndef LTREESITTER_ENCODING_H
+#define LTREESITTER_ENCODING_H
+
+#include "luautils.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <tree_sitter/api.h>
+
+// Helpers for working with source text in any of the encodings tree-sitter
+// can parse, without transcoding it when that can be avoided
+
+static inline bool encoding_is_utf16(TSInputEncoding encoding) {
+	return encoding == TSInputEncodingUTF16LE || encoding == TSInputEncodingUTF16BE;
+}
+
+// Advance `point` over `length` bytes of `text`
+// Columns are counted in bytes, like tree-sitter does
+TSPoint advance_point(TSPoint point, char const *text, uint32_t length, TSInputEncoding encoding);
+
+// Append `length` bytes of UTF-16 text to `out` as UTF-8
+// Unpaired surrogates (and a trailing odd byte) are replaced with U+FFFD
+// Returns false if `out` couldn't be grown
+bool utf16_to_utf8(StringBuilder *out, char const *text, uint32_t length, bool big_endian);
+
+// Whether UTF-16 text holds the same characters as UTF-8 text, without transcoding either
+bool utf16_eq_utf8(char const *utf16, uint32_t utf16_length, bool big_endian, char const *utf8, uint32_t utf8_length);
+
+#endif
@@ -1,10 +1,17 @@
 #include "language.h"
 #include "dynamiclib.h"
 #include "object.h"
+#include "parse_pool.h"
+#include "parser.h"
 #include "query.h"
+#include "symbol_set.h"
+#include "threads.h"
+#include "tree.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
+#include <stdio.h>
 
 #define TREE_SITTER_SYM "tree_sitter_"
 #define TREE_SITTER_SYM_LEN (sizeof TREE_SITTER_SYM - 1)
@@ -486,6 +493,28 @@ static int language_field_id_for_name(lua_State *L) {
 	return 1;
 }
 
+TSFieldId language_check_field(lua_State *L, int idx, TSLanguage const *l) {
+	switch (lua_type(L, idx)) {
+	case LUA_TSTRING: {
+		size_t len;
+		char const *name = lua_tolstring(L, idx, &len);
+		TSFieldId const id = ts_language_field_id_for_name(l, name, (uint32_t)len);
+		if (!id)
+			luaL_error(L, "Language has no field '%s'", name);
+		return id;
+	}
+	case LUA_TNUMBER: {
+		lua_Integer const id = lua_tointeger(L, idx);
+		if (id < 1 || id > (lua_Integer)ts_language_field_count(l))
+			luaL_error(L, "Language has no field %d", (int)id);
+		return (TSFieldId)id;
+	}
+	default:
+		luaL_error(L, "Expected a field name or FieldId, got %s", luaL_typename(L, idx));
+		return 0;
+	}
+}
+
 /* @teal-export Language.name_for_field_id: function(Language, FieldId): string [[
    Get the name for a numeric field id
 ]] */
@@ -587,6 +616,30 @@ static int language_subtypes(lua_State *L) {
 	return 1;
 }
 
+/* @teal-export Language.symbol_set: function(Language, types: string | Symbol | {string | Symbol}): SymbolSet [[
+   Create a set of node types that can be checked in C, without comparing type names
+
+   Types are given either as names, which match both named and anonymous nodes with that name, or as <code>Symbol</code>s.
+   The set can be passed in place of a list of types to <code>Node.descendants_of_type</code>,
+   and as a filter to <code>Node.children</code>, <code>Node.named_children</code>,
+   <code>Cursor.goto_first_child</code>, and <code>Cursor.goto_next_sibling</code>
+
+   <pre>
+   local identifiers = language:symbol_set{ "identifier", "field_identifier" }
+   for child in node:children(identifiers) do
+      print(child:source())
+   end
+   </pre>
+]] */
+static int language_symbol_set(lua_State *L) {
+	lua_settop(L, 2);
+	TSLanguage const *l = *language_assert(L, 1);
+	SymbolSet *const set = symbol_set_push(L, l); // language, types, set
+	bind_lifetimes(L, -1, 1);                     // set keeps language alive
+	symbol_set_add(L, set, 2);
+	return 1;
+}
+
 /* @teal-export Language.next_state: function(Language, StateId, Symbol): StateId [[
    Get the next parse state
 ]] */
@@ -631,6 +684,175 @@ static int make_query(lua_State *L) {
 	return 1;
 }
 
+// The items of a Language:parse_many or parse_files call
+// Any trees not yet handed to Lua are deleted when it is collected
+typedef struct {
+	uint32_t count;
+	BatchParse items[];
+} ParseBatch;
+
+static int parse_batch_gc(lua_State *L) {
+	ParseBatch *const batch = luaL_checkudata(L, 1, LTREESITTER_PARSE_BATCH_METATABLE_NAME);
+	for (uint32_t i = 0; i < batch->count; ++i) {
+		if (batch->items[i].result)
+			ts_tree_delete(batch->items[i].result);
+		batch->items[i].result = NULL;
+	}
+	return 0;
+}
+
+// ( [sources_idx]={string} | -- ParseBatch )
+static ParseBatch *push_batch(lua_State *L, int sources_idx, uint32_t count, bool paths) {
+	for (uint32_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, sources_idx, i + 1);
+		if (lua_type(L, -1) != LUA_TSTRING)
+			luaL_error(L, "Expected a string at index %d, got %s", (int)i + 1, luaL_typename(L, -1));
+		lua_pop(L, 1);
+	}
+
+	ParseBatch *const batch = lua_newuserdata(L, sizeof(ParseBatch) + sizeof(BatchParse) * count);
+	batch->count = count;
+	memset(batch->items, 0, sizeof(BatchParse) * count);
+	setmetatable(L, LTREESITTER_PARSE_BATCH_METATABLE_NAME);
+	for (uint32_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, sources_idx, i + 1);
+		size_t len;
+		// the strings are kept alive by the sources table
+		char const *str = lua_tolstring(L, -1, &len);
+		lua_pop(L, 1);
+		if (paths) {
+			batch->items[i].path = str;
+		} else {
+			luaL_argcheck(L, len <= UINT32_MAX, sources_idx, "source is too large to parse");
+			batch->items[i].text = str;
+			batch->items[i].length = (uint32_t)len;
+		}
+	}
+	return batch;
+}
+
+// Returns 0 and sets `size`, or the errno for why the size couldn't be found
+static int file_size(char const *path, uint32_t *size) {
+	FILE *const f = fopen(path, "rb");
+	if (!f)
+		return errno;
+	long end = -1;
+	if (fseek(f, 0, SEEK_END) == 0)
+		end = ftell(f);
+	int const err = errno;
+	fclose(f);
+	if (end < 0)
+		return err != 0 ? err : EIO;
+	if ((unsigned long)end > UINT32_MAX)
+		return EFBIG;
+	*size = (uint32_t)end;
+	return 0;
+}
+
+static uint32_t check_thread_count(lua_State *L, int idx) {
+	if (lua_isnoneornil(L, idx))
+		return hardware_thread_count();
+	lua_Integer const n = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, n >= 1, idx, "expected a positive number of threads");
+	return n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+}
+
+/* @teal-export Language.parse_many: function(Language, sources: {string}, threads?: integer, encoding?: Encoding): {Tree} [[
+   Parse each of the given strings, using up to <code>threads</code> threads at once (defaults to the number of processors)
+
+   Each thread uses its own parser, and this blocks until every source has been parsed.
+   The resulting trees are returned in the same order as their sources.
+
+   If ltreesitter was built with <code>LTREESITTER_NO_THREADS</code>, every source is parsed on the calling thread.
+]] */
+static int language_parse_many(lua_State *L) {
+	lua_settop(L, 4);
+	TSLanguage const *l = *language_assert(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	uint32_t const thread_count = check_thread_count(L, 3);
+	TSInputEncoding const encoding = encoding_from_str(L, 4);
+	uint32_t const count = (uint32_t)length_of(L, 2);
+
+	ParseBatch *const batch = push_batch(L, 2, count, false); // batch
+	parse_batch(l, encoding, batch->items, count, thread_count);
+
+	for (uint32_t i = 0; i < count; ++i)
+		if (!batch->items[i].result)
+			return luaL_error(L, "Unable to parse source %d", (int)i + 1);
+
+	lua_createtable(L, (int)count, 0); // batch, trees
+	for (uint32_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, 2, i + 1);                           // batch, trees, source
+		tree_push(L, batch->items[i].result, encoding, -1); // batch, trees, source, tree
+		batch->items[i].result = NULL;                      // now owned by the Tree
+		lua_rawseti(L, -3, i + 1);                          // batch, trees, source
+		lua_pop(L, 1);                                      // batch, trees
+	}
+	return 1;
+}
+
+/* @teal-export Language.parse_files: function(Language, paths: {string}, threads?: integer, encoding?: Encoding): {Tree}, {integer:string} [[
+   Like <code>Language.parse_many</code>, but reads the sources from the files at the given paths.
+   Files are read by the same threads that parse them.
+
+   Returns the trees, and a table mapping the index of each file that couldn't be read to an error message.
+   The trees for those files are left as <code>nil</code>.
+]] */
+static int language_parse_files(lua_State *L) {
+	lua_settop(L, 4);
+	TSLanguage const *l = *language_assert(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	uint32_t const thread_count = check_thread_count(L, 3);
+	TSInputEncoding const encoding = encoding_from_str(L, 4);
+	uint32_t const count = (uint32_t)length_of(L, 2);
+
+	ParseBatch *const batch = push_batch(L, 2, count, true); // batch
+
+	// files are read straight into the SourceTexts the trees will keep, so
+	// those are allocated up front, sized by each file's size at this point
+	lua_createtable(L, (int)count, 0); // batch, sources
+	int const sources_idx = lua_gettop(L);
+	for (uint32_t i = 0; i < count; ++i) {
+		BatchParse *const item = &batch->items[i];
+		uint32_t size = 0;
+		item->read_errno = file_size(item->path, &size);
+		if (item->read_errno != 0)
+			continue;
+		SourceText *const source = source_text_push_uninitialized(L, size); // batch, sources, source text
+		if (!source)
+			return ALLOC_FAIL(L);
+		item->buffer = source->text;
+		item->capacity = size;
+		lua_rawseti(L, sources_idx, i + 1); // batch, sources
+	}
+
+	parse_batch(l, encoding, batch->items, count, thread_count);
+
+	lua_createtable(L, (int)count, 0); // batch, sources, trees
+	lua_newtable(L);                   // batch, sources, trees, errors
+	for (uint32_t i = 0; i < count; ++i) {
+		BatchParse *const item = &batch->items[i];
+		if (item->read_errno != 0 || !item->result) {
+			lua_pushfstring(
+				L,
+				"%s: %s",
+				item->path,
+				item->read_errno != 0 ? strerror(item->read_errno) : "unable to parse"); // batch, sources, trees, errors, message
+			lua_rawseti(L, -2, i + 1); // batch, sources, trees, errors
+			continue;
+		}
+
+		lua_rawgeti(L, sources_idx, i + 1); // batch, sources, trees, errors, source text
+		// the file may have been truncated since its size was checked
+		source_text_assert(L, -1)->length = item->length;
+		tree_push_with_source_text(L, item->result, encoding, -1); // batch, sources, trees, errors, source text, tree
+		item->result = NULL;                                       // now owned by the Tree
+		lua_rawseti(L, -4, i + 1);                                 // batch, sources, trees, errors, source text
+		lua_pop(L, 1);                                             // batch, sources, trees, errors
+	}
+	return 2;
+}
+
 static const luaL_Reg language_methods[] = {
 	{"parser", make_parser},
 	{"query", make_query},
@@ -649,8 +871,12 @@ static const luaL_Reg language_methods[] = {
 	{"symbol_type", language_symbol_type},
 	{"supertypes", language_supertypes},
 	{"subtypes", language_subtypes},
+	{"symbol_set", language_symbol_set},
 	{"next_state", language_next_state},
 
+	{"parse_many", language_parse_many},
+	{"parse_files", language_parse_files},
+
 	{NULL, NULL}};
 
 static const luaL_Reg language_metamethods[] = {
@@ -659,5 +885,11 @@ static const luaL_Reg language_metamethods[] = {
 	{NULL, NULL}};
 
 void language_init_metatable(lua_State *L) {
+	static const luaL_Reg parse_batch_metamethods[] = {
+		{"__gc", parse_batch_gc},
+		{NULL, NULL}};
+	create_metatable(L, LTREESITTER_PARSE_BATCH_METATABLE_NAME, parse_batch_metamethods, NULL);
+	lua_pop(L, 1);
+
 	create_metatable(L, LTREESITTER_LANGUAGE_METATABLE_NAME, language_metamethods, language_methods);
 }
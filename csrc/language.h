@@ -10,6 +10,10 @@ void language_init_metatable(lua_State *);
 
 def_check_assert(TSLanguage const *, language, LTREESITTER_LANGUAGE_METATABLE_NAME)
 
+// ( [idx]=string|FieldId | -- )
+// Get the id of the field at idx, erroring if the language has no such field
+TSFieldId language_check_field(lua_State *L, int idx, TSLanguage const *);
+
 TSLanguage const *language_load_from(Dynlib dl, size_t lang_name_len, char const *language_name);
 
 // ( string ?string -- language string )
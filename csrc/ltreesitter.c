@@ -1,13 +1,18 @@
 #include <lauxlib.h>
 #include <lua.h>
 
+#include "cancellation.h"
+#include "chunk_cache.h"
 #include "language.h"
 #include "luautils.h"
 #include "node.h"
 #include "object.h"
+#include "parse_pool.h"
 #include "parser.h"
+#include "piece_table.h"
 #include "query.h"
 #include "query_cursor.h"
+#include "symbol_set.h"
 #include "tree.h"
 #include "tree_cursor.h"
 
@@ -19,6 +24,8 @@ static const luaL_Reg lib_funcs[] = {
 
 	{"load", language_load},
 	{"require", language_require},
+	{"cancellation_flag", cancellation_flag_new},
+	{"piece_table", piece_table_new},
 
 	{NULL, NULL},
 };
@@ -40,10 +47,16 @@ int luaopen_ltreesitter(lua_State *L) {
 	source_text_init_metatable(L);
 	language_init_metatable(L);
 	dynlib_init_metatable(L);
+	parse_future_init_metatable(L);
+	cancellation_flag_init_metatable(L);
+	piece_table_init_metatables(L);
+	chunk_cache_init_metatable(L);
+	symbol_set_init_metatable(L);
 
 	setup_registry_index(L);
 	setup_object_table(L);
 	setup_dynlib_cache(L);
+	query_cursor_setup_pool(L);
 
 	query_setup_predicate_tables(L);
 
@@ -114,6 +114,27 @@ int absindex(lua_State *L, int idx) {
 	return idx > 0 ? idx : lua_gettop(L) + 1 + idx;
 }
 
+bool tointeger_exact(lua_State *L, int idx, lua_Integer *out) {
+	if (lua_type(L, idx) != LUA_TNUMBER)
+		return false;
+#if LUA_VERSION_NUM >= 503
+	int isnum;
+	*out = lua_tointegerx(L, idx, &isnum);
+	return isnum;
+#else
+	// older versions truncate when converting, which is undefined for NaN and out of range values
+	lua_Number const n = lua_tonumber(L, idx);
+	lua_Number const limit = sizeof(lua_Integer) >= 8 ? 9007199254740992.0 : 2147483647.0;
+	if (!(n >= -limit && n <= limit))
+		return false;
+	lua_Integer const i = (lua_Integer)n;
+	if ((lua_Number)i != n)
+		return false;
+	*out = i;
+	return true;
+#endif
+}
+
 void setmetatable(lua_State *L, char const *mt_name) {
 	luaL_getmetatable(L, mt_name);
 	lua_setmetatable(L, -2);
@@ -53,6 +53,10 @@ int table_rawget(lua_State *L, int idx);
 // ( -- int )
 void pushinteger(lua_State *L, int n);
 
+// Get the value at idx if it is a number with an exact integer value
+// Fractions, NaN, infinities, and values out of lua_Integer's range are rejected
+bool tointeger_exact(lua_State *L, int idx, lua_Integer *out);
+
 // ( table -- table )
 void setfuncs(lua_State *L, const luaL_Reg l[]);
 
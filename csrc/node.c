@@ -6,9 +6,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "chunk_cache.h"
+#include "encoding.h"
+#include "language.h"
 #include "luautils.h"
 #include "node.h"
 #include "object.h"
+#include "piece_table.h"
+#include "symbol_set.h"
 #include "tree.h"
 #include "tree_cursor.h"
 #include "types.h"
@@ -87,7 +92,7 @@ static int node_end_byte(lua_State *L) {
 static int node_start_point(lua_State *L) {
 	TSNode n = *node_assert(L, 1);
 	TSPoint p = ts_node_start_point(n);
-	lua_newtable(L);
+	lua_createtable(L, 0, 2);
 
 	pushinteger(L, p.row);
 	lua_setfield(L, -2, "row");
@@ -104,7 +109,7 @@ static int node_start_point(lua_State *L) {
 static int node_end_point(lua_State *L) {
 	TSNode n = *node_assert(L, 1);
 	TSPoint p = ts_node_end_point(n);
-	lua_newtable(L);
+	lua_createtable(L, 0, 2);
 
 	pushinteger(L, p.row);
 	lua_setfield(L, -2, "row");
@@ -114,6 +119,50 @@ static int node_end_point(lua_State *L) {
 	return 1;
 }
 
+/* @teal-export Node.start_row_col: function(Node): (integer, integer) [[
+   Get the row and column of where the given node starts
+
+   Like <code>Node.start_point</code>, but returns them directly rather than allocating a <code>Point</code> table
+]] */
+static int node_start_row_col(lua_State *L) {
+	TSNode n = *node_assert(L, 1);
+	TSPoint p = ts_node_start_point(n);
+	pushinteger(L, p.row);
+	pushinteger(L, p.column);
+	return 2;
+}
+
+/* @teal-export Node.end_row_col: function(Node): (integer, integer) [[
+   Get the row and column of where the given node ends
+
+   Like <code>Node.end_point</code>, but returns them directly rather than allocating a <code>Point</code> table
+]] */
+static int node_end_row_col(lua_State *L) {
+	TSNode n = *node_assert(L, 1);
+	TSPoint p = ts_node_end_point(n);
+	pushinteger(L, p.row);
+	pushinteger(L, p.column);
+	return 2;
+}
+
+/* @teal-export Node.range: function(Node): (integer, integer, integer, integer, integer, integer) [[
+   Get the full extent of the given node without allocating any tables
+
+   Returns the start row, column, and byte offset followed by the end row, column, and (exclusive) byte offset
+]] */
+static int node_range(lua_State *L) {
+	TSNode n = *node_assert(L, 1);
+	TSPoint const start = ts_node_start_point(n);
+	TSPoint const end = ts_node_end_point(n);
+	pushinteger(L, start.row);
+	pushinteger(L, start.column);
+	pushinteger(L, ts_node_start_byte(n));
+	pushinteger(L, end.row);
+	pushinteger(L, end.column);
+	pushinteger(L, ts_node_end_byte(n));
+	return 6;
+}
+
 /* @teal-export Node.is_named: function(Node): boolean [[
    Get whether or not the current node is named
 ]] */
@@ -210,60 +259,185 @@ static int node_children_iterator(lua_State *L) {
 
 	lua_settop(L, 0);
 	TSTreeCursor *const c = tree_cursor_check(L, lua_upvalueindex(1));
+	ChildFilter const filter = {
+		.symbols = symbol_set_check(L, lua_upvalueindex(3)),
+		.field = (TSFieldId)lua_tointeger(L, lua_upvalueindex(4)),
+		.named_only = lua_toboolean(L, lua_upvalueindex(5)),
+	};
 
 	TSNode const n = ts_tree_cursor_current_node(c);
 	push_kept(L, lua_upvalueindex(1));
 	node_push(L, -1, n);
 
-	lua_pushboolean(L, ts_tree_cursor_goto_next_sibling(c));
+	lua_pushboolean(L, ts_tree_cursor_goto_next_sibling(c) && tree_cursor_skip_to_match(c, &filter));
 	lua_replace(L, lua_upvalueindex(2));
 
 	return 1;
 }
 
-static int node_named_children_iterator(lua_State *L) {
-	lua_settop(L, 0);
-	TSNode *n = node_assert(L, lua_upvalueindex(1));
-
-	uint32_t const idx = lua_tonumber(L, lua_upvalueindex(3));
-	pushinteger(L, idx + 1);
-	lua_replace(L, lua_upvalueindex(3));
-
-	if (idx >= ts_node_named_child_count(*n)) {
-		lua_pushnil(L);
-	} else {
-		lua_pushvalue(L, lua_upvalueindex(2));
-		node_push(
-			L, -1,
-			ts_node_named_child(*n, idx));
-	}
+// ( [node_idx]=Node, [filter_idx]=?SymbolSet|ChildFilter | -- function )
+// Iterating is done with a cursor, since ts_node_child and ts_node_named_child
+// have to scan past every child before the one asked for
+static void push_children_iterator(lua_State *L, int node_idx, int filter_idx, bool named_only) {
+	TSNode const n = *node_assert(L, node_idx);
+	ChildFilter filter = child_filter_check(L, filter_idx, ts_tree_language(n.tree)); // set
+	filter.named_only |= named_only;
 
-	return 1;
+	push_kept(L, node_idx);                                        // set, tree
+	TSTreeCursor *const c = tree_cursor_push(L, lua_gettop(L), n); // set, tree, cursor
+	lua_replace(L, -2);                                            // set, cursor
+	lua_insert(L, -2);                                             // cursor, set
+	lua_pushboolean(L, ts_tree_cursor_goto_first_child(c) && tree_cursor_skip_to_match(c, &filter));
+	lua_insert(L, -2); // cursor, more, set
+	pushinteger(L, filter.field);
+	lua_pushboolean(L, filter.named_only);
+	lua_pushcclosure(L, node_children_iterator, 5);
 }
 
-/* @teal-export Node.children: function(Node): function(): Node [[
+/* @teal-export Node.children: function(Node, filter?: SymbolSet | ChildFilter): function(): Node [[
    Iterate over a node's children
+
+   When a filter is given, only the children that pass it are iterated over.
+   The filter is checked in C, so the other children are never created as <code>Node</code>s.
+   A filter is either a <code>SymbolSet</code> of the types to iterate over, or a table with any of the fields
+    - <code>types</code>: a <code>SymbolSet</code> or anything <code>Language.symbol_set</code> accepts
+    - <code>field</code>: a field name or <code>FieldId</code> the children must have
+    - <code>named_only</code>: when true, only iterate over named children
+
+   <pre>
+   for declarator in declaration:children{ field = "declarator" } do
+      print(declarator:source())
+   end
+   </pre>
 ]] */
 static int node_children(lua_State *L) {
-	lua_settop(L, 1);
-	TSNode *n = node_assert(L, 1);
-	push_kept(L, 1);
-	TSTreeCursor *const c = tree_cursor_push(L, 2, *n);
-	bool const b = ts_tree_cursor_goto_first_child(c);
-	lua_pushboolean(L, b);
-	lua_pushcclosure(L, node_children_iterator, 2);
+	lua_settop(L, 2);
+	push_children_iterator(L, 1, 2, false);
 	return 1;
 }
 
-/* @teal-export Node.named_children: function(Node): function(): Node [[
+/* @teal-export Node.named_children: function(Node, filter?: SymbolSet | ChildFilter): function(): Node [[
    Iterate over a node's named children
+
+   Takes the same filters as <code>Node.children</code>
 ]] */
 static int node_named_children(lua_State *L) {
-	node_assert(L, 1);
-	push_kept(L, 1);
-	pushinteger(L, 0);
+	lua_settop(L, 2);
+	push_children_iterator(L, 1, 2, true);
+	return 1;
+}
+
+/* @teal-export Node.children_array: function(Node, named_only?: boolean): {Node} [[
+   Get a node's children (or only its named children) as an array
 
-	lua_pushcclosure(L, node_named_children_iterator, 3);
+   This creates every child in a single call, so it is cheaper than collecting the children from <code>Node.children</code>
+]] */
+static int node_children_array(lua_State *L) {
+	lua_settop(L, 2);
+	TSNode const n = *node_assert(L, 1);
+	bool const named_only = lua_toboolean(L, 2);
+	uint32_t const count = named_only ? ts_node_named_child_count(n) : ts_node_child_count(n);
+
+	push_kept(L, 1);                                    // node, named_only, tree
+	TSTreeCursor *const c = tree_cursor_push(L, 3, n); // node, named_only, tree, cursor
+	lua_createtable(L, (int)count, 0);                  // node, named_only, tree, cursor, children
+	if (count == 0 || !ts_tree_cursor_goto_first_child(c))
+		return 1;
+	int i = 0;
+	do {
+		TSNode const child = ts_tree_cursor_current_node(c);
+		if (named_only && !ts_node_is_named(child))
+			continue;
+		node_push(L, 3, child); // ..., children, child
+		lua_rawseti(L, -2, ++i);
+	} while (ts_tree_cursor_goto_next_sibling(c));
+	return 1;
+}
+
+/* @teal-export Node.field_children: function(Node, field: string | FieldId): {Node} [[
+   Get all of a node's children with the given field as an array
+
+   Unlike <code>Node.child_by_field_name</code>, this includes every child with the field rather than just the first
+]] */
+static int node_field_children(lua_State *L) {
+	lua_settop(L, 2);
+	TSNode const n = *node_assert(L, 1);
+	TSFieldId const field = language_check_field(L, 2, ts_tree_language(n.tree));
+
+	push_kept(L, 1);                                    // node, field, tree
+	TSTreeCursor *const c = tree_cursor_push(L, 3, n); // node, field, tree, cursor
+	if (!ts_tree_cursor_goto_first_child(c)) {
+		lua_newtable(L);
+		return 1;
+	}
+
+	// counting first is just a walk over the children, and saves growing the table
+	int count = 0;
+	do {
+		if (ts_tree_cursor_current_field_id(c) == field)
+			count += 1;
+	} while (ts_tree_cursor_goto_next_sibling(c));
+
+	lua_createtable(L, count, 0); // node, field, tree, cursor, children
+	if (count == 0)
+		return 1;
+	ts_tree_cursor_reset(c, n);
+	ts_tree_cursor_goto_first_child(c);
+	int i = 0;
+	do {
+		if (ts_tree_cursor_current_field_id(c) != field)
+			continue;
+		node_push(L, 3, ts_tree_cursor_current_node(c)); // ..., children, child
+		lua_rawseti(L, -2, ++i);
+	} while (i < count && ts_tree_cursor_goto_next_sibling(c));
+	return 1;
+}
+
+/* @teal-export Node.descendants_of_type: function(Node, types: SymbolSet | string | Symbol | {string | Symbol}, max?: integer): {Node} [[
+   Find the descendants of the given node (not including the node itself) with any of the given types, in pre-order
+
+   Types are given either as names, which match both named and anonymous nodes with that name, or as <code>Symbol</code>s.
+   A <code>SymbolSet</code> from <code>Language.symbol_set</code> can be given instead to avoid building a new set each call.
+   When <code>max</code> is given, at most that many nodes are returned.
+
+   The search is done in C with a single cursor, checking each node's symbol against the set,
+   so only the matching nodes are created as <code>Node</code>s.
+
+   <pre>
+   for _, call in ipairs(root:descendants_of_type{ "call_expression" }) do
+      print(call:child_by_field_name("function"):source())
+   end
+   </pre>
+]] */
+static int node_descendants_of_type(lua_State *L) {
+	lua_settop(L, 3);
+	TSNode const n = *node_assert(L, 1);
+	lua_Integer const max = luaL_optinteger(L, 3, -1);
+	luaL_argcheck(L, lua_isnil(L, 3) || max >= 0, 3, "expected a non-negative integer");
+
+	SymbolSet const *const set = symbol_set_from_arg(L, 2, ts_tree_language(n.tree)); // node, set, max
+
+	push_kept(L, 1);                                    // node, set, max, tree
+	TSTreeCursor *const c = tree_cursor_push(L, 4, n); // node, set, max, tree, cursor
+	lua_newtable(L);                                    // node, set, max, tree, cursor, result
+	lua_Integer count = 0;
+	if (max != 0 && ts_tree_cursor_goto_first_child(c)) {
+		for (;;) {
+			TSNode const d = ts_tree_cursor_current_node(c);
+			if (symbol_set_contains(set, ts_node_symbol(d))) {
+				node_push(L, 4, d); // ..., result, node
+				lua_rawseti(L, -2, (int)++count);
+				if (count == max)
+					break;
+			}
+			if (ts_tree_cursor_goto_first_child(c))
+				continue;
+			while (!ts_tree_cursor_goto_next_sibling(c))
+				if (!ts_tree_cursor_goto_parent(c))
+					goto done;
+		}
+	}
+done:
 	return 1;
 }
 
@@ -429,18 +603,45 @@ static int node_child_by_field_id(lua_State *L) {
 
 MaybeOwnedString node_get_source(lua_State *L) { // node
 	TSNode n = *node_assert(L, -1);
-	ltreesitter_Tree *const tree = node_push_tree(L, -1); // node, tree
+	node_push_tree(L, -1); // node, tree
+	MaybeOwnedString result = node_get_source_in(L, -1, n);
+	lua_pop(L, 1); // node
+	return result;
+}
+
+MaybeOwnedString node_get_source_in(lua_State *L, int tree_idx, TSNode n) {
+	tree_idx = absindex(L, tree_idx);
+	ltreesitter_Tree *const tree = tree_assert(L, tree_idx);
 	if (tree->text_or_null_if_function_reader) {
 		uint32_t const start = ts_node_start_byte(n);
 		uint32_t const end = ts_node_end_byte(n);
-		lua_pop(L, 1); // node
 		return (MaybeOwnedString){
 			.owned = false,
-			.data = tree->text_or_null_if_function_reader->text + start,
+			.data = tree->text_or_null_if_function_reader + start,
 			.length = end - start,
 		};
 	}
-	push_kept(L, -1); // node, tree, reader
+	push_kept(L, tree_idx); // ..., reader
+
+	PieceTableSnapshot const *const snapshot = piece_table_snapshot_check(L, -1);
+	if (snapshot) {
+		MaybeOwnedString result;
+		if (!piece_table_snapshot_sub(snapshot, ts_node_start_byte(n), ts_node_end_byte(n), &result))
+			ALLOC_FAIL(L);
+		lua_pop(L, 1); // ...
+		return result;
+	}
+
+	ChunkCache const *const cache = chunk_cache_check(L, -1);
+	if (cache) {
+		MaybeOwnedString result;
+		if (chunk_cache_get(cache, ts_node_start_byte(n), ts_node_end_byte(n), &result)) {
+			lua_pop(L, 1); // ...
+			return result;
+		}
+		push_kept(L, -1);  // ..., cache, reader
+		lua_remove(L, -2); // ..., reader
+	}
 
 	uint32_t const start_byte = ts_node_start_byte(n);
 	uint32_t const end_byte = ts_node_end_byte(n);
@@ -455,18 +656,23 @@ MaybeOwnedString node_get_source(lua_State *L) { // node
 	while (needed_bytes > 0) {
 		lua_pushvalue(L, -1); // ..., reader
 
-		uint32_t const start_index = start_byte + end_byte - needed_bytes;
+		uint32_t const start_index = end_byte - needed_bytes;
 
 		pushinteger(L, start_index); // ..., reader, index
-		lua_newtable(L);
-		{ // ..., reader, index, point
+		int nargs = 2;
+		if (tree->reader_takes_integer_points) {
+			pushinteger(L, position.row);    // ..., reader, index, row
+			pushinteger(L, position.column); // ..., reader, index, row, column
+			nargs = 3;
+		} else {
+			lua_createtable(L, 0, 2); // ..., reader, index, point
 			pushinteger(L, position.row);
 			lua_setfield(L, -2, "row");
 			pushinteger(L, position.column);
 			lua_setfield(L, -2, "column");
-		} // ..., reader, index, point
+		}
 
-		if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+		if (lua_pcall(L, nargs, 1, 0) != LUA_OK) {
 			sb_free(&sb);
 			lua_error(L);
 		}
@@ -487,17 +693,8 @@ MaybeOwnedString node_get_source(lua_State *L) { // node
 			needed_bytes -= len;
 
 			// According to https://github.com/tree-sitter/tree-sitter/discussions/1286
-			// `column` is just a byte offset
-			//
-			// TODO: what about utf-16?
-			for (size_t i = 0; i < len; ++i) {
-				if (str[i] == '\n') {
-					position.row += 1;
-					position.column = 0;
-				} else {
-					position.column += 1;
-				}
-			}
+			// `column` is just a byte offset, in utf-16 too
+			position = advance_point(position, str, (uint32_t)len, tree->encoding);
 		} break;
 		default:
 			sb_free(&sb);
@@ -505,8 +702,8 @@ MaybeOwnedString node_get_source(lua_State *L) { // node
 			break;
 		}
 		lua_pop(L, 1);
-	} // node, tree, reader
-	lua_pop(L, 2); // node
+	} // ..., reader
+	lua_pop(L, 1); // ...
 
 	return (MaybeOwnedString){
 		.owned = true,
@@ -525,6 +722,32 @@ static int node_get_source_method(lua_State *L) {
 	return 1;
 }
 
+/* @teal-export Node.source_utf8: function(Node): string [[
+   Get the source of <code>Node</code> like <code>Node.source</code>, but as utf-8 even when the tree was parsed from utf-16
+]]*/
+static int node_get_source_utf8(lua_State *L) {
+	lua_settop(L, 1);
+	TSNode const n = *node_assert(L, 1);
+	ltreesitter_Tree const *const tree = node_push_tree(L, 1); // node, tree
+	MaybeOwnedString str = node_get_source_in(L, -1, n);
+	if (!encoding_is_utf16(tree->encoding)) {
+		mos_push_to_lua(L, str);
+		mos_free(&str);
+		return 1;
+	}
+
+	StringBuilder sb = {0};
+	bool const ok = utf16_to_utf8(&sb, str.data, str.length, tree->encoding == TSInputEncodingUTF16BE);
+	mos_free(&str);
+	if (!ok) {
+		sb_free(&sb);
+		return ALLOC_FAIL(L);
+	}
+	sb_push_to_lua(L, &sb);
+	sb_free(&sb);
+	return 1;
+}
+
 /* @teal-export Node.create_cursor: function(Node): Cursor [[
    Create a new cursor at the given node
 ]] */
@@ -556,10 +779,14 @@ static const luaL_Reg node_methods[] = {
 	{"child_by_field_id", node_child_by_field_id},
 	{"child_count", node_child_count},
 	{"children", node_children},
+	{"children_array", node_children_array},
 	{"create_cursor", node_tree_cursor_create},
+	{"descendants_of_type", node_descendants_of_type},
 	{"end_index", node_end_byte},
 	{"end_byte_offset", node_end_byte},
 	{"end_point", node_end_point},
+	{"end_row_col", node_end_row_col},
+	{"field_children", node_field_children},
 	{"is_extra", node_is_extra},
 	{"is_missing", node_is_missing},
 	{"is_named", node_is_named},
@@ -573,10 +800,13 @@ static const luaL_Reg node_methods[] = {
 	{"next_sibling", node_next_sibling},
 	{"prev_named_sibling", node_prev_named_sibling},
 	{"prev_sibling", node_prev_sibling},
+	{"range", node_range},
 	{"source", node_get_source_method},
+	{"source_utf8", node_get_source_utf8},
 	{"start_index", node_start_index},
 	{"start_byte_offset", node_start_byte},
 	{"start_point", node_start_point},
+	{"start_row_col", node_start_row_col},
 	{"type", node_type},
 	{"grammar_type", node_grammar_type},
 
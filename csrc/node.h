@@ -15,6 +15,10 @@ void node_push(lua_State *L, int tree_idx, TSNode n);
 // ( Node -- Node )
 MaybeOwnedString node_get_source(lua_State *);
 
+// ( [tree_idx]=Tree | -- )
+// Get the source of a node that belongs to the tree at `tree_idx`
+MaybeOwnedString node_get_source_in(lua_State *, int tree_idx, TSNode);
+
 // ( [node_idx]=Node | -- Tree )
 ltreesitter_Tree *node_push_tree(lua_State *L, int node_idx);
 
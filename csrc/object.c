@@ -1,6 +1,36 @@
 #include "object.h"
 #include "luautils.h"
 
+#ifdef LTREESITTER_USE_USERVALUES
+
+void setup_object_table(lua_State *L) {
+	(void)L;
+}
+
+void push_kept(lua_State *L, int keeper_idx) {
+#if LUA_VERSION_NUM >= 504
+	lua_getiuservalue(L, keeper_idx, 1); // keeper.uservalue[1]
+#else
+	lua_getuservalue(L, keeper_idx); // keeper.uservalue
+#endif
+	if (lua_isnil(L, -1)) {
+		luaL_error(L, "Internal error: object is not a keeper!");
+	}
+}
+
+void bind_lifetimes(lua_State *L, int as_long_as_this_object_lives, int so_shall_this_one) {
+	as_long_as_this_object_lives = absindex(L, as_long_as_this_object_lives);
+
+	lua_pushvalue(L, so_shall_this_one); // kept
+#if LUA_VERSION_NUM >= 504
+	lua_setiuservalue(L, as_long_as_this_object_lives, 1);
+#else
+	lua_setuservalue(L, as_long_as_this_object_lives);
+#endif
+}
+
+#else
+
 static char const *object_field = "objects";
 // map of objects to their parents
 // use when an object relies on its parent being alive
@@ -34,3 +64,5 @@ void bind_lifetimes(lua_State *L, int as_long_as_this_object_lives, int so_shall
 	lua_rawset(L, -3);                              // objtable
 	lua_pop(L, 1);
 }
+
+#endif
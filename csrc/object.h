@@ -3,25 +3,52 @@
 
 #include <lua.h>
 
-// The object table is a table in the registry with __mode = 'k' that we use to represent ownership.
-// This allows lua to garbage collect our data structures properly.
+// Objects that rely on another object being alive (nodes on their tree, trees
+// on their source text, etc.) express that through a keeper-kept relationship
 //
-// The basic idea is just a table with weak keys:
-//
-//    object_table[keeper] = kept
+//    keeper -> kept
 //
 // As long as `keeper` lives, so does `kept`
 //
-// With this setup, one `kept` object can have multiple `keeper`s, e.g. if a
-// tree is copied, its source text needs to be kept alive as long as any copies
-// of the tree are alive.
+// One `kept` object can have multiple `keeper`s, e.g. if a tree is copied, its
+// source text needs to be kept alive as long as any copies of the tree are
+// alive. A keeper only ever keeps one object alive, if more is needed, keep a
+// table.
+//
+// There are two backends for this, selected at compile time:
+//
+// Uservalues (default for Lua >= 5.3, or define LTREESITTER_USE_USERVALUES):
+//    Userdata may be allocated with what is called a uservalue (or multiple
+//    in >=5.4) which is basically just a slot for a strong reference to
+//    another lua object. The kept object is stored directly in the keeper's
+//    first uservalue, so binding is just a store and no global table is
+//    involved. Every keeper must be a full userdata.
 //
-// A note on "uservalues":
-// Lua 5.3 onward essentially has this built in. Userdata may be allocated with
-// what is called a uservalue (or multiple in >=5.4) which is basically just a
-// slot for a strong reference to another lua object. But! We want to support
-// 5.1, 5.2, and luajit.
+// Object table (default for Lua 5.1, 5.2, and luajit, or define LTREESITTER_USE_OBJECT_TABLE):
+//    A table in the registry with __mode = 'k':
+//
+//       object_table[keeper] = kept
+//
+//    5.1 and luajit have no uservalues, and 5.2 only allows tables as
+//    uservalues, so they use this.
+
+#if defined(LTREESITTER_USE_USERVALUES) && defined(LTREESITTER_USE_OBJECT_TABLE)
+#error "Only one of LTREESITTER_USE_USERVALUES and LTREESITTER_USE_OBJECT_TABLE may be defined"
+#endif
+
+#if !defined(LTREESITTER_USE_USERVALUES) && !defined(LTREESITTER_USE_OBJECT_TABLE)
+#if LUA_VERSION_NUM >= 503
+#define LTREESITTER_USE_USERVALUES
+#else
+#define LTREESITTER_USE_OBJECT_TABLE
+#endif
+#endif
+
+#if defined(LTREESITTER_USE_USERVALUES) && LUA_VERSION_NUM < 503
+#error "LTREESITTER_USE_USERVALUES requires Lua 5.3 or later"
+#endif
 
+// Does nothing when using uservalues
 void setup_object_table(lua_State *);
 
 // Creates a keeper-kept relationship between two objects
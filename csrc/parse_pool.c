@@ -0,0 +1,555 @@
+#include <errno.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "luautils.h"
+#include "object.h"
+#include "parse_pool.h"
+#include "threads.h"
+#include "tree.h"
+
+typedef enum {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE,
+} JobState;
+
+typedef struct ParseJob {
+	struct ParseJob *next; // next in the pool's queue
+
+	TSLanguage const *language; // a copy owned by the job, the future keeps the Language (and its dynlib) alive
+	TSRange *ranges;
+	uint32_t range_count;
+	TSInputEncoding encoding;
+	char const *text; // owned by the future's source string
+	uint32_t length;
+	TSTree *old_tree; // a copy owned by the job, may be NULL
+	ParseLimits limits; // the flag is kept alive by the future
+
+	// written by the worker
+	TSTree *result;
+
+	JobState state; // guarded by the pool's mutex
+	uint32_t volatile cancelled;
+
+	// write end is written to once the job is done, only created when asked for
+	int notify_fds[2];
+} ParseJob;
+
+static char const *read_job_text(void *payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read) {
+	(void)position;
+	ParseJob const *const job = payload;
+	if (byte_index >= job->length) {
+		*bytes_read = 0;
+		return "";
+	}
+	*bytes_read = job->length - byte_index;
+	return job->text + byte_index;
+}
+
+static bool job_progress(TSParseState *state) {
+	ParseJob *const job = state->payload;
+	if (atomic_load_u32(&job->cancelled) != 0)
+		return true;
+	return parse_limits_exceeded(&job->limits);
+}
+
+static void run_parse_job(TSParser *parser, ParseJob *job) {
+	if (!ts_parser_set_language(parser, job->language)) {
+		job->result = NULL;
+		return;
+	}
+	ts_parser_set_included_ranges(parser, job->ranges, job->range_count);
+
+	TSInput const input = {
+		.payload = job,
+		.read = read_job_text,
+		.encoding = job->encoding,
+		.decode = NULL,
+	};
+	TSParseOptions const options = {
+		.payload = job,
+		.progress_callback = job_progress,
+	};
+	job->result = ts_parser_parse_with_options(parser, job->old_tree, input, options);
+	if (!job->result)
+		ts_parser_reset(parser);
+}
+
+static void free_job(ParseJob *job) {
+	if (job->language)
+		ts_language_delete(job->language);
+	if (job->result)
+		ts_tree_delete(job->result);
+	if (job->old_tree)
+		ts_tree_delete(job->old_tree);
+	free(job->ranges);
+#ifndef _WIN32
+	if (job->notify_fds[0] >= 0) {
+		close(job->notify_fds[0]);
+		close(job->notify_fds[1]);
+	}
+#endif
+	free(job);
+}
+
+#ifndef _WIN32
+static void notify_job_done(ParseJob *job) {
+	if (job->notify_fds[1] >= 0) {
+		char const byte = 0;
+		ssize_t const written = write(job->notify_fds[1], &byte, 1);
+		(void)written;
+	}
+}
+#endif
+
+#ifndef LTREESITTER_NO_THREADS
+
+static char const *pool_registry_field = "parse_pool";
+
+#define PARSE_POOL_MAX_WORKERS 16
+
+typedef struct {
+	Mutex mutex;
+	Condition job_available;
+	Condition job_done;
+	ParseJob *head, *tail;
+	bool shutting_down;
+	// set once the workers have been joined, after which futures must not
+	// touch the mutex or queue
+	bool closed;
+	uint32_t worker_count;
+	Thread workers[PARSE_POOL_MAX_WORKERS];
+} ParsePool;
+
+static void worker_main(void *arg) {
+	ParsePool *const pool = arg;
+	TSParser *const parser = ts_parser_new();
+
+	mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->head && !pool->shutting_down)
+			condition_wait(&pool->job_available, &pool->mutex);
+		if (pool->shutting_down)
+			break;
+
+		ParseJob *const job = pool->head;
+		pool->head = job->next;
+		if (!pool->head)
+			pool->tail = NULL;
+		job->state = JOB_RUNNING;
+		mutex_unlock(&pool->mutex);
+
+		run_parse_job(parser, job);
+
+		mutex_lock(&pool->mutex);
+		job->state = JOB_DONE;
+#ifndef _WIN32
+		notify_job_done(job);
+#endif
+		condition_broadcast(&pool->job_done);
+	}
+	mutex_unlock(&pool->mutex);
+
+	ts_parser_delete(parser);
+}
+
+// Stop and join the workers, then tear down the pool's mutex and conditions
+static void parse_pool_close(ParsePool *pool) {
+	if (pool->closed)
+		return;
+
+	mutex_lock(&pool->mutex);
+	pool->shutting_down = true;
+	condition_broadcast(&pool->job_available);
+	mutex_unlock(&pool->mutex);
+
+	for (uint32_t i = 0; i < pool->worker_count; ++i)
+		thread_join(pool->workers[i]);
+
+	pool->closed = true;
+	condition_destroy(&pool->job_done);
+	condition_destroy(&pool->job_available);
+	mutex_destroy(&pool->mutex);
+}
+
+static int parse_pool_gc(lua_State *L) {
+	parse_pool_close(luaL_checkudata(L, 1, LTREESITTER_PARSE_POOL_METATABLE_NAME));
+	return 0;
+}
+
+// ( -- ParsePool )
+static ParsePool *push_pool(lua_State *L) {
+	push_registry_field(L, pool_registry_field); // ?pool
+	if (!lua_isnil(L, -1))
+		return lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	ParsePool *const pool = lua_newuserdata(L, sizeof(ParsePool)); // pool
+	memset(pool, 0, sizeof *pool);
+	pool->closed = true; // until everything is initialized
+	setmetatable(L, LTREESITTER_PARSE_POOL_METATABLE_NAME);
+
+	if (!mutex_init(&pool->mutex))
+		luaL_error(L, "Unable to create mutex for parse pool");
+	if (!condition_init(&pool->job_available)) {
+		mutex_destroy(&pool->mutex);
+		luaL_error(L, "Unable to create condition variable for parse pool");
+	}
+	if (!condition_init(&pool->job_done)) {
+		condition_destroy(&pool->job_available);
+		mutex_destroy(&pool->mutex);
+		luaL_error(L, "Unable to create condition variable for parse pool");
+	}
+	pool->closed = false;
+
+	uint32_t wanted = hardware_thread_count();
+	if (wanted > PARSE_POOL_MAX_WORKERS)
+		wanted = PARSE_POOL_MAX_WORKERS;
+	for (uint32_t i = 0; i < wanted; ++i) {
+		if (!thread_create(&pool->workers[pool->worker_count], worker_main, pool))
+			break;
+		pool->worker_count += 1;
+	}
+	if (pool->worker_count == 0) {
+		parse_pool_close(pool); // cleans up the mutex and conditions
+		luaL_error(L, "Unable to create any worker threads for parse pool");
+	}
+
+	lua_pushvalue(L, -1);
+	set_registry_field(L, pool_registry_field);
+	lua_pop(L, 1);
+	return pool;
+}
+
+#endif
+
+typedef struct {
+	ParseJob *job;
+#ifndef LTREESITTER_NO_THREADS
+	ParsePool *pool;
+#endif
+} ParseFuture;
+
+def_check_assert(ParseFuture, parse_future, LTREESITTER_PARSE_FUTURE_METATABLE_NAME)
+
+// Indexes into the table kept by each future
+enum {
+	FUTURE_KEPT_POOL = 1,
+	FUTURE_KEPT_PARSER,
+	FUTURE_KEPT_LANGUAGE,
+	FUTURE_KEPT_SOURCE,
+	FUTURE_KEPT_TREE, // the resulting tree, once it has been asked for
+	FUTURE_KEPT_CANCELLATION_FLAG,
+	FUTURE_KEPT_COUNT = FUTURE_KEPT_CANCELLATION_FLAG,
+};
+
+static bool job_is_done(ParseFuture *f) {
+#ifdef LTREESITTER_NO_THREADS
+	return f->job->state == JOB_DONE;
+#else
+	if (f->pool->closed)
+		return f->job->state == JOB_DONE;
+	mutex_lock(&f->pool->mutex);
+	bool const done = f->job->state == JOB_DONE;
+	mutex_unlock(&f->pool->mutex);
+	return done;
+#endif
+}
+
+void parse_future_push(
+	lua_State *L,
+	TSParser const *parser,
+	int parser_idx,
+	int string_idx,
+	TSInputEncoding encoding,
+	TSTree const *old_tree_or_null,
+	ParseLimits limits,
+	int flag_idx) {
+	parser_idx = absindex(L, parser_idx);
+	string_idx = absindex(L, string_idx);
+	flag_idx = absindex(L, flag_idx);
+
+	ParseFuture *const f = lua_newuserdata(L, sizeof(ParseFuture)); // future
+	*f = (ParseFuture){0};
+	setmetatable(L, LTREESITTER_PARSE_FUTURE_METATABLE_NAME);
+
+	ParseJob *const job = calloc(1, sizeof(ParseJob));
+	if (!job)
+		ALLOC_FAIL(L);
+	job->notify_fds[0] = job->notify_fds[1] = -1;
+	f->job = job;
+
+	size_t len;
+	job->text = lua_tolstring(L, string_idx, &len);
+	job->length = (uint32_t)len;
+	job->language = ts_language_copy(ts_parser_language(parser));
+	job->encoding = encoding;
+	job->old_tree = old_tree_or_null ? ts_tree_copy(old_tree_or_null) : NULL;
+	job->limits = limits;
+
+	uint32_t range_count;
+	TSRange const *ranges = ts_parser_included_ranges(parser, &range_count);
+	if (range_count > 0) {
+		job->ranges = malloc(sizeof(TSRange) * range_count);
+		if (!job->ranges)
+			ALLOC_FAIL(L);
+		memcpy(job->ranges, ranges, sizeof(TSRange) * range_count);
+		job->range_count = range_count;
+	}
+
+	lua_createtable(L, FUTURE_KEPT_COUNT, 0); // future, kept
+	lua_pushvalue(L, parser_idx);
+	lua_rawseti(L, -2, FUTURE_KEPT_PARSER);
+	push_kept(L, parser_idx); // future, kept, language
+	lua_rawseti(L, -2, FUTURE_KEPT_LANGUAGE);
+	lua_pushvalue(L, string_idx);
+	lua_rawseti(L, -2, FUTURE_KEPT_SOURCE);
+	lua_pushvalue(L, flag_idx);
+	lua_rawseti(L, -2, FUTURE_KEPT_CANCELLATION_FLAG);
+
+#ifdef LTREESITTER_NO_THREADS
+	// no workers, so just do the work now with a temporary parser
+	TSParser *const temp = ts_parser_new();
+	if (!temp)
+		ALLOC_FAIL(L);
+	run_parse_job(temp, job);
+	ts_parser_delete(temp);
+	job->state = JOB_DONE;
+#else
+	ParsePool *const pool = push_pool(L); // future, kept, pool
+	lua_rawseti(L, -2, FUTURE_KEPT_POOL); // future, kept
+	f->pool = pool;
+
+	mutex_lock(&pool->mutex);
+	job->state = JOB_QUEUED;
+	if (pool->tail)
+		pool->tail->next = job;
+	else
+		pool->head = job;
+	pool->tail = job;
+	condition_signal(&pool->job_available);
+	mutex_unlock(&pool->mutex);
+#endif
+
+	bind_lifetimes(L, -2, -1); // future keeps parser, source, and pool alive
+	lua_pop(L, 1);             // future
+}
+
+/* @teal-export ParseFuture.ready: function(ParseFuture): boolean [[
+   Returns whether the parse has finished, i.e. whether <code>ParseFuture:wait</code> would return without blocking
+]] */
+static int parse_future_ready(lua_State *L) {
+	ParseFuture *const f = parse_future_assert(L, 1);
+	lua_pushboolean(L, job_is_done(f));
+	return 1;
+}
+
+/* @teal-export ParseFuture.wait: function(ParseFuture): Tree, string [[
+   Blocks until the parse has finished and returns the resulting tree
+
+   Calling this multiple times will return the same tree
+
+   If the parse was stopped by its <code>ParseOptions</code>, returns <code>nil</code> and either <code>"timed out"</code> or <code>"cancelled"</code>
+]] */
+static int parse_future_wait(lua_State *L) {
+	ParseFuture *const f = parse_future_assert(L, 1);
+	ParseJob *const job = f->job;
+
+#ifndef LTREESITTER_NO_THREADS
+	if (!f->pool->closed) {
+		mutex_lock(&f->pool->mutex);
+		while (job->state != JOB_DONE)
+			condition_wait(&f->pool->job_done, &f->pool->mutex);
+		mutex_unlock(&f->pool->mutex);
+	}
+#endif
+
+	push_kept(L, 1); // kept
+	lua_rawgeti(L, -1, FUTURE_KEPT_TREE); // kept, ?tree
+	if (!lua_isnil(L, -1))
+		return 1;
+	if (!job->result) {
+		if (job->limits.hit == PARSE_LIMIT_NONE)
+			return 1;
+		parse_limits_push_reason(L, &job->limits); // kept, nil, reason
+		return 2;
+	}
+	lua_pop(L, 1); // kept
+
+	lua_rawgeti(L, -1, FUTURE_KEPT_SOURCE);       // kept, source
+	tree_push(L, job->result, job->encoding, -1); // kept, source, tree
+	job->result = NULL;                           // now owned by the Tree
+	lua_pushvalue(L, -1);                         // kept, source, tree, tree
+	lua_rawseti(L, -4, FUTURE_KEPT_TREE);         // kept, source, tree
+	return 1;
+}
+
+/* @teal-export ParseFuture.fd: function(ParseFuture): integer [[
+   Returns a file descriptor that becomes readable once the parse has finished, for use with <code>poll</code>, <code>select</code>, or an event loop.
+   The descriptor is owned by the future and is closed when the future is garbage collected.
+
+   Returns <code>nil</code> on platforms without pipes (i.e. Windows)
+]] */
+static int parse_future_fd(lua_State *L) {
+	ParseFuture *const f = parse_future_assert(L, 1);
+#ifdef _WIN32
+	(void)f;
+	lua_pushnil(L);
+	return 1;
+#else
+	ParseJob *const job = f->job;
+#ifndef LTREESITTER_NO_THREADS
+	bool const locked = !f->pool->closed;
+	if (locked)
+		mutex_lock(&f->pool->mutex);
+#endif
+	bool ok = true;
+	if (job->notify_fds[0] < 0) {
+		ok = pipe(job->notify_fds) == 0;
+		if (!ok)
+			job->notify_fds[0] = job->notify_fds[1] = -1;
+		else if (job->state == JOB_DONE)
+			notify_job_done(job);
+	}
+#ifndef LTREESITTER_NO_THREADS
+	if (locked)
+		mutex_unlock(&f->pool->mutex);
+#endif
+	if (!ok)
+		return luaL_error(L, "Unable to create pipe for ParseFuture");
+	pushinteger(L, job->notify_fds[0]);
+	return 1;
+#endif
+}
+
+static int parse_future_gc(lua_State *L) {
+	ParseFuture *const f = parse_future_assert(L, 1);
+	ParseJob *const job = f->job;
+	if (!job)
+		return 0;
+
+#ifndef LTREESITTER_NO_THREADS
+	ParsePool *const pool = f->pool;
+	if (pool && !pool->closed) {
+		mutex_lock(&pool->mutex);
+		if (job->state == JOB_QUEUED) {
+			// not started, just take it out of the queue
+			ParseJob **it = &pool->head;
+			ParseJob *previous = NULL;
+			while (*it && *it != job) {
+				previous = *it;
+				it = &(*it)->next;
+			}
+			if (*it) {
+				*it = job->next;
+				if (pool->tail == job)
+					pool->tail = previous;
+			}
+		} else {
+			// the worker may still be reading the source, which is about to be collected
+			atomic_store_u32(&job->cancelled, 1);
+			while (job->state != JOB_DONE)
+				condition_wait(&pool->job_done, &pool->mutex);
+		}
+		mutex_unlock(&pool->mutex);
+	}
+#endif
+
+	free_job(job);
+	f->job = NULL;
+	return 0;
+}
+
+static const luaL_Reg parse_future_methods[] = {
+	{"ready", parse_future_ready},
+	{"wait", parse_future_wait},
+	{"fd", parse_future_fd},
+	{NULL, NULL}};
+
+static const luaL_Reg parse_future_metamethods[] = {
+	{"__gc", parse_future_gc},
+	{NULL, NULL}};
+
+void parse_future_init_metatable(lua_State *L) {
+	create_metatable(L, LTREESITTER_PARSE_FUTURE_METATABLE_NAME, parse_future_metamethods, parse_future_methods);
+#ifndef LTREESITTER_NO_THREADS
+	static const luaL_Reg pool_metamethods[] = {
+		{"__gc", parse_pool_gc},
+		{NULL, NULL}};
+	create_metatable(L, LTREESITTER_PARSE_POOL_METATABLE_NAME, pool_metamethods, NULL);
+	lua_pop(L, 1);
+#endif
+}
+
+typedef struct {
+	TSLanguage const *language;
+	TSInputEncoding encoding;
+	BatchParse *items;
+	uint32_t count;
+	uint32_t volatile next; // index of the next item to be claimed by a thread
+} Batch;
+
+static bool read_batch_file(BatchParse *item) {
+	FILE *const f = fopen(item->path, "rb");
+	if (!f) {
+		item->read_errno = errno;
+		return false;
+	}
+	size_t const bytes_read = fread(item->buffer, 1, item->capacity, f);
+	if (bytes_read < item->capacity && ferror(f)) {
+		item->read_errno = errno;
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+	// the file may have been truncated since its size was checked
+	item->text = item->buffer;
+	item->length = (uint32_t)bytes_read;
+	return true;
+}
+
+static void batch_worker(void *arg) {
+	Batch *const batch = arg;
+	TSParser *const parser = ts_parser_new();
+	if (!ts_parser_set_language(parser, batch->language)) {
+		ts_parser_delete(parser);
+		return;
+	}
+	for (;;) {
+		uint32_t const i = atomic_fetch_add_u32(&batch->next, 1);
+		if (i >= batch->count)
+			break;
+		BatchParse *const item = &batch->items[i];
+		if (item->read_errno != 0 || (item->path && !read_batch_file(item)))
+			continue;
+		item->result = ts_parser_parse_string_encoding(parser, NULL, item->text, item->length, batch->encoding);
+	}
+	ts_parser_delete(parser);
+}
+
+void parse_batch(
+	TSLanguage const *language,
+	TSInputEncoding encoding,
+	BatchParse *items,
+	uint32_t count,
+	uint32_t thread_count) {
+	Batch batch = {
+		.language = ts_language_copy(language),
+		.encoding = encoding,
+		.items = items,
+		.count = count,
+		.next = 0,
+	};
+	if (thread_count > count)
+		thread_count = count;
+	run_on_threads(batch_worker, &batch, thread_count);
+	ts_language_delete(batch.language);
+}
@@ -0,0 +1,60 @@
+#ifndef LTREESITTER_PARSE_POOL_H
+#define LTREESITTER_PARSE_POOL_H
+
+#include "cancellation.h"
+#include "types.h"
+#include <lua.h>
+#include <tree_sitter/api.h>
+
+// Parser:parse_string_async hands parses off to a pool of worker threads
+// owned by the lua_State, each with its own TSParser. The pool is created
+// the first time it is needed and its workers are joined when the lua_State
+// is closed.
+//
+// Each parse is represented in Lua by a ParseFuture which keeps the source
+// string, the parser and its Language alive until it is collected. The job
+// holds its own copy of the TSLanguage, so the worker never borrows the parser's
+
+// ( -- )
+void parse_future_init_metatable(lua_State *L);
+
+// ( [parser_idx]=Parser, [string_idx]=string, [flag_idx]=?CancellationFlag | -- ParseFuture )
+// `parser` is used for its language and included ranges, the parse itself is
+// done with a worker's parser. The future keeps the limits' flag alive
+void parse_future_push(
+	lua_State *L,
+	TSParser const *parser,
+	int parser_idx,
+	int string_idx,
+	TSInputEncoding,
+	TSTree const *old_tree_or_null,
+	ParseLimits,
+	int flag_idx);
+
+// One source for parse_batch
+typedef struct {
+	// Either `text` or `path` is given. When `path` is given, up to `capacity`
+	// bytes of the file are read into `buffer` (which the caller provides) by
+	// the thread that parses it, and `text` and `length` are set to them
+	char const *text;
+	uint32_t length;
+	char const *path;
+	char *buffer;
+	uint32_t capacity;
+	int read_errno; // set when reading `path` failed, the item is skipped if it is already set
+
+	TSTree *result;
+} BatchParse;
+
+// Parses every item with up to `thread_count` threads (the calling thread
+// included), each with its own TSParser. Blocks until every item is done.
+// Does not touch any lua_State, so the caller must keep every `text` alive,
+// and the Language (which owns the dynlib the language's code lives in)
+void parse_batch(
+	TSLanguage const *,
+	TSInputEncoding,
+	BatchParse *items,
+	uint32_t count,
+	uint32_t thread_count);
+
+#endif
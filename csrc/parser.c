@@ -6,14 +6,20 @@
 
 #include <tree_sitter/api.h>
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "cancellation.h"
+#include "chunk_cache.h"
 #include "dynamiclib.h"
+#include "encoding.h"
 #include "luautils.h"
 #include "object.h"
+#include "parse_pool.h"
 #include "parser.h"
+#include "piece_table.h"
 
 #include "query.h"
 #include "tree.h"
@@ -46,7 +52,7 @@ static int parser_gc(lua_State *L) {
    end
 ]]*/
 
-static TSInputEncoding encoding_from_str(lua_State *L, int str_index) {
+TSInputEncoding encoding_from_str(lua_State *L, int str_index) {
 	size_t len = 0;
 	char const *encoding_str = lua_tolstring(L, str_index, &len);
 
@@ -84,14 +90,84 @@ static TSInputEncoding encoding_from_str(lua_State *L, int str_index) {
 	return TSInputEncodingUTF8;
 }
 
-/* @teal-export Parser.parse_string: function(Parser, string, ?Encoding, ?Tree): Tree [[
+typedef struct {
+	char const *text;
+	uint32_t length;
+} StringInput;
+
+static char const *read_string_input(void *payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read) {
+	(void)position;
+	StringInput const *const input = payload;
+	if (byte_index >= input->length) {
+		*bytes_read = 0;
+		return "";
+	}
+	*bytes_read = input->length - byte_index;
+	return input->text + byte_index;
+}
+
+// Parse a string, checking the given limits while parsing if there are any
+// If the limits stop the parse, the parser is reset since the string it would
+// resume with may not be around anymore
+static TSTree *parse_string_with_limits(
+	TSParser *p,
+	TSTree const *old_tree,
+	char const *text,
+	uint32_t length,
+	TSInputEncoding encoding,
+	ParseLimits *limits) {
+	if (!parse_limits_active(limits))
+		return ts_parser_parse_string_encoding(p, old_tree, text, length, encoding);
+
+	StringInput string_input = {.text = text, .length = length};
+	TSInput const input = {
+		.payload = &string_input,
+		.read = read_string_input,
+		.encoding = encoding,
+		.decode = NULL,
+	};
+	TSParseOptions const options = {
+		.payload = limits,
+		.progress_callback = parse_limits_progress_callback,
+	};
+	TSTree *const tree = ts_parser_parse_with_options(p, old_tree, input, options);
+	if (!tree)
+		ts_parser_reset(p);
+	return tree;
+}
+
+// ( -- nil, ?string )
+static int push_parse_failure(lua_State *L, ParseLimits const *limits) {
+	lua_pushnil(L);
+	if (limits->hit == PARSE_LIMIT_NONE)
+		return 1;
+	parse_limits_push_reason(L, limits);
+	return 2;
+}
+
+/* @teal-inline [[
+   interface ParseOptions
+      timeout_micros: integer
+      cancellation_flag: CancellationFlag
+      integer_points: boolean
+      chunk_cache_bytes: integer
+   end
+]] */
+
+/* @teal-export Parser.parse_string: function(Parser, string, ?Encoding, ?Tree, ?ParseOptions): Tree, string [[
    Uses the given parser to parse the string
 
    If <code>Tree</code> is provided then it will be used to create a new updated tree
    (but it is the responsibility of the programmer to make the correct <code>Tree:edit</code> calls)
+
+   <code>ParseOptions</code> can limit how long the parse may take:
+   <code>timeout_micros</code> stops parsing once that many microseconds have passed,
+   and <code>cancellation_flag</code> (see <code>ltreesitter.cancellation_flag</code>) stops parsing once the flag is set.
+   These are checked without calling into Lua.
+   If parsing is stopped, <code>nil</code> and either <code>"timed out"</code> or <code>"cancelled"</code> are returned, and the parser is reset.
 ]] */
 static int parser_parse_string(lua_State *L) {
-	lua_settop(L, 4);
+	lua_settop(L, 5);
 	TSParser *p = *parser_assert(L, 1);
 	size_t len;
 	char const *to_parse = luaL_checklstring(L, 2, &len);
@@ -102,35 +178,221 @@ static int parser_parse_string(lua_State *L) {
 		? NULL
 		: tree_assert(L, 4)->tree;
 
+	ParseLimits limits = parse_limits_from_options(L, 5); // ?flag
+
 	// #CustomEncoding
 	// if (encoding == TSInputEncodingCustom)
 	//	return luaL_error(L, "Custom encodings are only usable with `parse_with`");
 
-	TSTree *const tree = ts_parser_parse_string_encoding(p, old_tree, to_parse, len, encoding);
-	if (!tree) {
+	TSTree *const tree = parse_string_with_limits(p, old_tree, to_parse, len, encoding, &limits);
+	if (!tree)
+		return push_parse_failure(L, &limits);
+
+	tree_push(L, tree, encoding, 2);
+	return 1;
+}
+
+/* @teal-export Parser.parse_string_async: function(Parser, string, ?Encoding, ?Tree, ?ParseOptions): ParseFuture [[
+   Like <code>Parser.parse_string</code>, but the parsing is done on a background thread
+
+   The parse is done by a pool of worker threads (one per processor) which is started the first time this is called.
+   The parser's language and included ranges at the time of this call are used.
+
+   Use <code>ParseFuture:wait</code> to get the resulting tree.
+   If the future is garbage collected before the parse finishes, the parse is cancelled.
+
+   If ltreesitter was built with <code>LTREESITTER_NO_THREADS</code>, the parse is done immediately.
+
+   <code>ParseOptions</code> are the same as for <code>Parser.parse_string</code>, the timeout starts from when this is called.
+   If the parse is stopped by them, <code>ParseFuture:wait</code> returns <code>nil</code> and the reason.
+]] */
+static int parser_parse_string_async(lua_State *L) {
+	lua_settop(L, 5);
+	TSParser *p = *parser_assert(L, 1);
+	luaL_checkstring(L, 2);
+	TSInputEncoding encoding = encoding_from_str(L, 3);
+	TSTree const *const old_tree = lua_type(L, 4) == LUA_TNIL
+		? NULL
+		: tree_assert(L, 4)->tree;
+	ParseLimits const limits = parse_limits_from_options(L, 5); // ?flag
+	parse_future_push(L, p, 1, 2, encoding, old_tree, limits, -1);
+	return 1;
+}
+
+// ( -- nil, string )
+static int push_file_error(lua_State *L, char const *path, FILE *to_close) {
+	int const err = errno;
+	if (to_close)
+		fclose(to_close);
+	lua_pushnil(L);
+	lua_pushfstring(L, "%s: %s", path, strerror(err));
+	return 2;
+}
+
+/* @teal-export Parser.parse_file: function(Parser, path: string, ?Encoding, ?Tree, ?ParseOptions): Tree, string [[
+   Reads the file at <code>path</code> and parses it
+
+   The contents of the file are read directly into the source of the resulting tree, so this avoids
+   both reading the file into a Lua string and copying that string like <code>Parser.parse_string</code> would.
+
+   If the file can't be read, returns <code>nil</code> and an error message
+
+   If <code>Tree</code> is provided then it will be used to create a new updated tree
+   (but it is the responsibility of the programmer to make the correct <code>Tree:edit</code> calls)
+
+   <code>ParseOptions</code> are the same as for <code>Parser.parse_string</code>
+]] */
+static int parser_parse_file(lua_State *L) {
+	lua_settop(L, 5);
+	TSParser *p = *parser_assert(L, 1);
+	char const *path = luaL_checkstring(L, 2);
+	TSInputEncoding encoding = encoding_from_str(L, 3);
+	TSTree *const old_tree = lua_type(L, 4) == LUA_TNIL
+		? NULL
+		: tree_assert(L, 4)->tree;
+	ParseLimits limits = parse_limits_from_options(L, 5); // ?flag
+
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return push_file_error(L, path, NULL);
+
+	if (fseek(f, 0, SEEK_END) != 0)
+		return push_file_error(L, path, f);
+	long const size = ftell(f);
+	if (size < 0 || fseek(f, 0, SEEK_SET) != 0)
+		return push_file_error(L, path, f);
+	if ((unsigned long)size > UINT32_MAX) {
+		fclose(f);
 		lua_pushnil(L);
-		return 1;
+		lua_pushfstring(L, "%s: file is too large to parse", path);
+		return 2;
 	}
 
-	tree_push(L, tree, len, to_parse);
+	SourceText *const source = source_text_push_uninitialized(L, (uint32_t)size); // ?flag, source text
+	if (!source) {
+		fclose(f);
+		ALLOC_FAIL(L);
+	}
+	size_t const bytes_read = fread(source->text, 1, (size_t)size, f);
+	if (bytes_read < (size_t)size && ferror(f))
+		return push_file_error(L, path, f);
+	fclose(f);
+	// the file may have been truncated after we checked its size
+	source->length = (uint32_t)bytes_read;
+
+	TSTree *const tree = parse_string_with_limits(p, old_tree, source->text, source->length, encoding, &limits);
+	if (!tree)
+		return push_parse_failure(L, &limits);
+
+	tree_push_with_source_text(L, tree, encoding, -1); // ?flag, source text, tree
 	return 1;
 }
 
+// The point of `byte` in the text of `t`, starting from the deepest node that
+// contains it rather than the start of the text when possible
+static TSPoint point_for_byte(ltreesitter_Tree const *t, uint32_t byte) {
+	TSNode const n = ts_node_descendant_for_byte_range(ts_tree_root_node(t->tree), byte, byte);
+	uint32_t start = ts_node_start_byte(n);
+	TSPoint point = ts_node_start_point(n);
+	if (ts_node_is_null(n) || start > byte) {
+		start = 0;
+		point = (TSPoint){0, 0};
+	}
+	return advance_point(point, t->text_or_null_if_function_reader + start, byte - start, t->encoding);
+}
+
+/* @teal-export Parser.reparse: function(Parser, Tree, start_byte: integer, old_end_byte: integer, replacement: string): Tree, {Range} [[
+   Replace the bytes from <code>start_byte</code> up to (but not including) <code>old_end_byte</code> of the tree's source with <code>replacement</code>,
+   and incrementally reparse the result using the given tree. Returns the new tree and the ranges that changed between the two trees (see <code>Tree.get_changed_ranges</code>).
+
+   This computes the points of the edit and calls <code>Tree.edit</code> for you, and builds the new source in a single copy.
+   The given tree is left as it was (it is copied before being edited) so it, and its nodes, still match its source.
+
+   The tree must have been parsed from a string or file (not with <code>Parser.parse_with</code>), and the new tree uses the same encoding.
+
+   <pre>
+   local tree = parser:parse_string("int x = 1;")
+   local new_tree, changed = parser:reparse(tree, 8, 9, "42")
+   print(new_tree:root():source()) -- int x = 42;
+   </pre>
+]] */
+static int parser_reparse(lua_State *L) {
+	lua_settop(L, 5);
+	TSParser *const p = *parser_assert(L, 1);
+	ltreesitter_Tree *const t = tree_assert(L, 2);
+	lua_Integer const start_byte = luaL_checkinteger(L, 3);
+	lua_Integer const old_end_byte = luaL_checkinteger(L, 4);
+	size_t replacement_len;
+	char const *replacement = luaL_checklstring(L, 5, &replacement_len);
+
+	if (!t->text_or_null_if_function_reader)
+		return luaL_argerror(L, 2, "tree was parsed with a reader function, so it has no source to edit");
+	luaL_argcheck(L, start_byte >= 0 && start_byte <= t->text_length, 3, "start_byte is out of the range of the tree's source");
+	luaL_argcheck(L, old_end_byte >= start_byte && old_end_byte <= t->text_length, 4, "old_end_byte must be between start_byte and the end of the tree's source");
+	uint64_t const new_length = (uint64_t)t->text_length - (uint64_t)(old_end_byte - start_byte) + replacement_len;
+	luaL_argcheck(L, new_length <= UINT32_MAX, 5, "the resulting source is too large to parse");
+
+	char const *const old_text = t->text_or_null_if_function_reader;
+	uint32_t const start = (uint32_t)start_byte;
+	uint32_t const old_end = (uint32_t)old_end_byte;
+	uint32_t const new_end = start + (uint32_t)replacement_len;
+
+	TSPoint const start_point = point_for_byte(t, start);
+	TSInputEdit const edit = {
+		.start_byte = start,
+		.old_end_byte = old_end,
+		.new_end_byte = new_end,
+		.start_point = start_point,
+		.old_end_point = advance_point(start_point, old_text + start, old_end - start, t->encoding),
+		.new_end_point = advance_point(start_point, replacement, (uint32_t)replacement_len, t->encoding),
+	};
+
+	SourceText *const source = source_text_push_uninitialized(L, (uint32_t)new_length); // source text
+	if (!source)
+		return ALLOC_FAIL(L);
+	memcpy(source->text, old_text, start);
+	memcpy(source->text + start, replacement, replacement_len);
+	memcpy(source->text + new_end, old_text + old_end, t->text_length - old_end);
+
+	TSTree *const edited = ts_tree_copy(t->tree);
+	ts_tree_edit(edited, &edit);
+	TSTree *const new_tree = ts_parser_parse_string_encoding(p, edited, source->text, source->length, t->encoding);
+	if (!new_tree) {
+		ts_tree_delete(edited);
+		lua_pushnil(L);
+		return 1;
+	}
+
+	tree_push_with_source_text(L, new_tree, t->encoding, -1); // source text, tree
+	tree_push_changed_ranges(L, edited, new_tree);            // source text, tree, ranges
+	ts_tree_delete(edited);
+	return 2;
+}
+
 #define read_callback_idx 2
 #define progress_callback_idx 3
-// #define decode_callback_idx 4
+// kept on the stack so it lives as long as the parse
+#define cancellation_flag_idx 4
+#define chunk_cache_idx 5
+// #define decode_callback_idx 5
 
 typedef struct {
 	lua_State *L;
 	bool callback_errored;
+	ParseLimits limits;
 } ProgressInfo;
 static bool progress_callback(TSParseState *state) {
-	// assumed state, lua callback is on top of the stack
+	// assumed state, lua callback is at progress_callback_idx
 	ProgressInfo *const info = state->payload;
+	if (parse_limits_exceeded(&info->limits))
+		return true;
+
 	lua_State *const L = info->L;
-	lua_settop(L, progress_callback_idx);
+	if (lua_isnil(L, progress_callback_idx))
+		return false;
+	lua_settop(L, chunk_cache_idx);
 
-	lua_pushvalue(L, -1);
+	lua_pushvalue(L, progress_callback_idx);
 	lua_pushboolean(L, state->has_error);
 	lua_pushinteger(L, state->current_byte_offset);
 	if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
@@ -149,21 +411,30 @@ enum ReadError {
 struct CallInfo {
 	lua_State *L;
 	enum ReadError read_error;
+	bool integer_points;
+	ChunkCache *cache_or_null;
 };
 static char const *read_callback(void *payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read) {
 	struct CallInfo *const i = payload;
 	lua_State *const L = i->L;
-	lua_settop(L, 3);
+	lua_settop(L, chunk_cache_idx);
 	lua_pushvalue(L, read_callback_idx); // grab a copy of the function
 	pushinteger(L, byte_index);
 
-	lua_newtable(L);                 // byte_index, {}
-	pushinteger(L, position.row);    // byte_index, {}, row
-	lua_setfield(L, -2, "row");      // byte_index, { row = row }
-	pushinteger(L, position.column); // byte_index, { row = row }, column
-	lua_setfield(L, -2, "column");   // byte_index, { row = row, column = column }
+	int nargs = 2;
+	if (i->integer_points) {
+		pushinteger(L, position.row);    // byte_index, row
+		pushinteger(L, position.column); // byte_index, row, column
+		nargs = 3;
+	} else {
+		lua_createtable(L, 0, 2);        // byte_index, {}
+		pushinteger(L, position.row);    // byte_index, {}, row
+		lua_setfield(L, -2, "row");      // byte_index, { row = row }
+		pushinteger(L, position.column); // byte_index, { row = row }, column
+		lua_setfield(L, -2, "column");   // byte_index, { row = row, column = column }
+	}
 
-	if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+	if (lua_pcall(L, nargs, 1, 0) != LUA_OK) {
 		i->read_error = READERR_PCALL;
 		*bytes_read = 0;
 		return NULL;
@@ -184,6 +455,8 @@ static char const *read_callback(void *payload, uint32_t byte_index, TSPoint pos
 	size_t n = 0;
 	char const *read_str = lua_tolstring(L, -1, &n);
 	*bytes_read = n;
+	if (i->cache_or_null)
+		chunk_cache_add(i->cache_or_null, byte_index, read_str, (uint32_t)n);
 	return read_str;
 }
 
@@ -191,11 +464,12 @@ static char const *read_callback(void *payload, uint32_t byte_index, TSPoint pos
 
 /* @teal-export Parser.parse_with: function(
          Parser,
-         reader: (function(integer, Point): string),
+         reader: (function(byte_index: integer, Point): string) | (function(byte_index: integer, row: integer, column: integer): string),
          progress_callback?: (function(has_error: boolean, byte_offset: integer): boolean),
          encoding?: Encoding,
-         old_tree?: Tree
-      ): Tree [[
+         old_tree?: Tree,
+         options?: ParseOptions
+      ): Tree, string [[
 
    <code>reader</code> should be a function that takes a byte index
    and a <code>Point</code> and returns the text at that point. The
@@ -212,20 +486,56 @@ static char const *read_callback(void *payload, uint32_t byte_index, TSPoint pos
 
    <code>encoding</code> defaults to <code>"utf-8"</code> when not provided.
 
-   May return nil if the progress callback cancelled parsing
+   <code>options</code> are the same as for <code>Parser.parse_string</code>, and are checked before calling <code>progress_callback</code>.
+   Additionally, when <code>options.integer_points</code> is set, <code>reader</code> is called as <code>reader(byte_index, row, column)</code>
+   rather than being given a <code>Point</code> table, which avoids allocating a table for every call.
+   (The same goes for any calls made to get the source of the resulting tree's nodes.)
+
+   Getting the source of the resulting tree's nodes normally calls <code>reader</code> again. When <code>options.chunk_cache_bytes</code> is given,
+   up to that many bytes of the text <code>reader</code> returned while parsing are retained by the tree instead, and node sources (and so
+   query predicates like <code>#eq?</code>) are copied straight out of it. Past that limit the text at the start of the document is dropped
+   first, and any source that isn't retained is read with <code>reader</code> as usual.
+
+   May return nil if the progress callback cancelled parsing, or nil and the reason if <code>options</code> did
 ]] */
 static int parser_parse_with(lua_State *L) {
-	lua_settop(L, 5);
+	lua_settop(L, 6);
 	TSParser *const p = *parser_assert(L, 1);
 	TSTree *old_tree = NULL;
 	TSInputEncoding encoding = encoding_from_str(L, 4);
 	if (!lua_isnil(L, 5)) {
 		old_tree = tree_assert(L, 5)->tree;
 	}
-	lua_pop(L, 2);
+	ParseLimits const limits = parse_limits_from_options(L, 6); // parser, reader, progress, encoding, old tree, options, ?flag
+	bool integer_points = false;
+	ChunkCache *cache = NULL;
+	if (lua_type(L, 6) == LUA_TTABLE) {
+		lua_getfield(L, 6, "integer_points"); // ..., ?flag, integer_points
+		integer_points = lua_toboolean(L, -1);
+		lua_pop(L, 1); // ..., ?flag
+
+		lua_getfield(L, 6, "chunk_cache_bytes"); // ..., ?flag, ?bytes
+		if (!lua_isnil(L, -1)) {
+			lua_Integer max_bytes;
+			if (!tointeger_exact(L, -1, &max_bytes) || max_bytes < 0)
+				return luaL_error(L, "Expected chunk_cache_bytes to be a non-negative integer");
+			cache = chunk_cache_push(L, (size_t)max_bytes); // ..., ?flag, ?bytes, cache
+			lua_remove(L, -2);                              // ..., ?flag, cache
+		} else {
+			lua_pop(L, 1);   // ..., ?flag
+			lua_pushnil(L); // ..., ?flag, nil
+		}
+	} else {
+		lua_pushnil(L); // ..., ?flag, nil
+	}
+	lua_replace(L, chunk_cache_idx);       // parser, reader, progress, encoding, ?cache, options, ?flag
+	lua_replace(L, cancellation_flag_idx); // parser, reader, progress, ?flag, ?cache, options
+	lua_settop(L, chunk_cache_idx);        // parser, reader, progress, ?flag, ?cache
 	struct CallInfo read_payload = {
 		.L = L,
 		.read_error = READERR_NONE,
+		.integer_points = integer_points,
+		.cache_or_null = cache,
 	};
 
 	// #CustomEncoding
@@ -242,6 +552,7 @@ static int parser_parse_with(lua_State *L) {
 	ProgressInfo progress_payload = {
 		.L = L,
 		.callback_errored = false,
+		.limits = limits,
 	};
 
 	TSParseOptions options = {
@@ -249,7 +560,7 @@ static int parser_parse_with(lua_State *L) {
 		.progress_callback = progress_callback,
 	};
 
-	TSTree *t = lua_isnil(L, progress_callback_idx)
+	TSTree *t = lua_isnil(L, progress_callback_idx) && !parse_limits_active(&limits)
 		? ts_parser_parse(p, old_tree, input)
 		: ts_parser_parse_with_options(p, old_tree, input, options);
 
@@ -269,10 +580,69 @@ static int parser_parse_with(lua_State *L) {
 
 	if (!t) {
 		lua_pushnil(L);
-		return 1;
+		if (progress_payload.limits.hit == PARSE_LIMIT_NONE)
+			return 1;
+		// like parse_string, a parse stopped by its limits isn't resumed by the next call
+		ts_parser_reset(p);
+		parse_limits_push_reason(L, &progress_payload.limits);
+		return 2;
+	}
+	lua_settop(L, chunk_cache_idx);
+	if (cache) {
+		bind_lifetimes(L, chunk_cache_idx, read_callback_idx); // cache keeps reader alive
+		tree_push_with_reader(L, t, encoding, chunk_cache_idx);
+	} else {
+		tree_push_with_reader(L, t, encoding, read_callback_idx);
+	}
+	tree_assert(L, -1)->reader_takes_integer_points = integer_points;
+
+	return 1;
+}
+
+/* @teal-export Parser.parse_piece_table: function(Parser, PieceTable, ?Tree, ?ParseOptions): Tree, string [[
+   Parse the current contents of a <code>PieceTable</code>
+
+   The text is read straight out of the table's pieces without being copied into a string. The resulting tree
+   keeps a snapshot of the table as it was when parsed, so editing the table afterwards doesn't affect the tree's source.
+
+   If <code>Tree</code> is provided then it will be used to create a new updated tree, which is cheap when it has been
+   kept up to date with <code>tree:edit(pt:replace(...))</code> and friends
+
+   <code>ParseOptions</code> are the same as for <code>Parser.parse_string</code>
+]] */
+static int parser_parse_piece_table(lua_State *L) {
+	lua_settop(L, 4);
+	TSParser *const p = *parser_assert(L, 1);
+	(void)piece_table_assert(L, 2);
+	TSTree *const old_tree = lua_isnil(L, 3)
+		? NULL
+		: tree_assert(L, 3)->tree;
+
+	ParseLimits limits = parse_limits_from_options(L, 4);             // ?flag
+	PieceTableSnapshot *const snapshot = piece_table_snapshot_push(L, 2); // ?flag, snapshot
+
+	TSInput const input = {
+		.payload = snapshot,
+		.read = piece_table_snapshot_read,
+		.encoding = TSInputEncodingUTF8,
+		.decode = NULL,
+	};
+	TSTree *tree;
+	if (parse_limits_active(&limits)) {
+		TSParseOptions const options = {
+			.payload = &limits,
+			.progress_callback = parse_limits_progress_callback,
+		};
+		tree = ts_parser_parse_with_options(p, old_tree, input, options);
+		if (!tree)
+			ts_parser_reset(p);
+	} else {
+		tree = ts_parser_parse(p, old_tree, input);
 	}
-	tree_push_with_reader(L, t, 2);
+	if (!tree)
+		return push_parse_failure(L, &limits);
 
+	tree_push_with_reader(L, tree, TSInputEncodingUTF8, -1); // ?flag, snapshot, tree
 	return 1;
 }
 
@@ -406,7 +776,11 @@ static const luaL_Reg parser_methods[] = {
 	{"get_ranges", parser_get_ranges},
 
 	{"parse_string", parser_parse_string},
+	{"parse_file", parser_parse_file},
+	{"parse_string_async", parser_parse_string_async},
 	{"parse_with", parser_parse_with},
+	{"reparse", parser_reparse},
+	{"parse_piece_table", parser_parse_piece_table},
 
 	{"language", parser_language},
 
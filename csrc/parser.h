@@ -9,4 +9,7 @@ def_check_assert(TSParser *, parser, LTREESITTER_PARSER_METATABLE_NAME)
 // ( -- table )
 void parser_init_metatable(lua_State *L);
 
+// Checks that the given index is nil (utf-8) or the name of an Encoding
+TSInputEncoding encoding_from_str(lua_State *L, int str_index);
+
 #endif
@@ -0,0 +1,361 @@
+#include <ctype.h>
+#include <lua.h>
+#include <string.h>
+
+#include "pattern.h"
+
+// Characters that give a pattern any meaning beyond its literal bytes
+static char const *const specials = "^$*+?.([%-)";
+
+// Returns a pointer just past the single character class that starts at `p`,
+// or NULL if it is malformed or uses something we leave to Lua
+static char const *class_end(char const *p, char const *end) {
+	char const c = *p++;
+	if (c == '%') {
+		if (p >= end)
+			return NULL;
+		// %z was deprecated and is not in every version, and %g is only in >=5.2
+		if (*p == 'z' || *p == 'Z')
+			return NULL;
+#if LUA_VERSION_NUM < 502
+		if (*p == 'g' || *p == 'G')
+			return NULL;
+#endif
+		return p + 1;
+	}
+	if (c == '[') {
+		if (p < end && *p == '^')
+			++p;
+		// the first character of a set is always part of it, even if it is ']'
+		for (;;) {
+			if (p >= end)
+				return NULL;
+			char const sc = *p++;
+			if (sc == '%') {
+				if (p >= end)
+					return NULL;
+				if (*p == 'z' || *p == 'Z')
+					return NULL;
+#if LUA_VERSION_NUM < 502
+				if (*p == 'g' || *p == 'G')
+					return NULL;
+#endif
+				++p;
+			}
+			if (p < end && *p == ']')
+				break;
+		}
+		return p + 1;
+	}
+	return p;
+}
+
+static bool class_matches(unsigned char c, unsigned char cl) {
+	bool result;
+	switch (tolower(cl)) {
+	case 'a': result = isalpha(c); break;
+	case 'c': result = iscntrl(c); break;
+	case 'd': result = isdigit(c); break;
+	case 'g': result = isgraph(c); break;
+	case 'l': result = islower(c); break;
+	case 'p': result = ispunct(c); break;
+	case 's': result = isspace(c); break;
+	case 'u': result = isupper(c); break;
+	case 'w': result = isalnum(c); break;
+	case 'x': result = isxdigit(c); break;
+	default: return cl == c;
+	}
+	if (isupper(cl))
+		result = !result;
+	return result;
+}
+
+// `p` points to the opening '[' and `ec` to the closing ']'
+static bool set_matches(unsigned char c, char const *p, char const *ec) {
+	bool negate = false;
+	++p;
+	if (*p == '^') {
+		negate = true;
+		++p;
+	}
+	while (p < ec) {
+		if (*p == '%') {
+			++p;
+			if (class_matches(c, (unsigned char)*p))
+				return !negate;
+			++p;
+		} else if (p[1] == '-' && p + 2 < ec) {
+			if ((unsigned char)p[0] <= c && c <= (unsigned char)p[2])
+				return !negate;
+			p += 3;
+		} else {
+			if ((unsigned char)*p == c)
+				return !negate;
+			++p;
+		}
+	}
+	return negate;
+}
+
+static bool single_matches(char const *s, char const *p, char const *ep) {
+	unsigned char const c = (unsigned char)*s;
+	switch (*p) {
+	case '.': return true;
+	case '%': return class_matches(c, (unsigned char)p[1]);
+	case '[': return set_matches(c, p, ep - 1);
+	default: return (unsigned char)*p == c;
+	}
+}
+
+typedef struct {
+	char const *src_start;
+	char const *src_end;
+	char const *pat_end;
+} MatchState;
+
+static char const *do_match(MatchState const *ms, char const *s, char const *p);
+
+static char const *max_expand(MatchState const *ms, char const *s, char const *p, char const *ep) {
+	ptrdiff_t i = 0;
+	while (s + i < ms->src_end && single_matches(s + i, p, ep))
+		++i;
+	for (; i >= 0; --i) {
+		char const *const result = do_match(ms, s + i, ep + 1);
+		if (result)
+			return result;
+	}
+	return NULL;
+}
+
+static char const *min_expand(MatchState const *ms, char const *s, char const *p, char const *ep) {
+	for (;;) {
+		char const *const result = do_match(ms, s, ep + 1);
+		if (result)
+			return result;
+		if (s < ms->src_end && single_matches(s, p, ep))
+			++s;
+		else
+			return NULL;
+	}
+}
+
+// `p` points to the two characters after %b
+static char const *match_balance(MatchState const *ms, char const *s, char const *p) {
+	if (s >= ms->src_end || *s != p[0])
+		return NULL;
+	char const open = p[0];
+	char const close = p[1];
+	int depth = 1;
+	while (++s < ms->src_end) {
+		if (*s == close) {
+			if (--depth == 0)
+				return s + 1;
+		} else if (*s == open) {
+			++depth;
+		}
+	}
+	return NULL;
+}
+
+// Returns the end of the match, or NULL if there is none
+// Assumes the pattern was validated by pattern_compile
+static char const *do_match(MatchState const *ms, char const *s, char const *p) {
+	while (p < ms->pat_end) {
+		switch (*p) {
+		case '(':
+		case ')':
+			// only whether something matches is needed, so captures do nothing
+			++p;
+			continue;
+		case '$':
+			if (p + 1 == ms->pat_end)
+				return s == ms->src_end ? s : NULL;
+			break;
+		case '%':
+			if (p[1] == 'b') {
+				s = match_balance(ms, s, p + 2);
+				if (!s)
+					return NULL;
+				p += 4;
+				continue;
+			}
+			if (p[1] == 'f') {
+				p += 2;
+				char const *const ep = class_end(p, ms->pat_end);
+				unsigned char const previous = s == ms->src_start ? '\0' : (unsigned char)s[-1];
+				unsigned char const current = s < ms->src_end ? (unsigned char)*s : '\0';
+				if (set_matches(previous, p, ep - 1) || !set_matches(current, p, ep - 1))
+					return NULL;
+				p = ep;
+				continue;
+			}
+			break;
+		}
+
+		char const *const ep = class_end(p, ms->pat_end);
+		bool const matched = s < ms->src_end && single_matches(s, p, ep);
+		switch (ep < ms->pat_end ? *ep : '\0') {
+		case '?':
+			if (matched) {
+				char const *const result = do_match(ms, s + 1, ep + 1);
+				if (result)
+					return result;
+			}
+			p = ep + 1;
+			continue;
+		case '+':
+			return matched ? max_expand(ms, s + 1, p, ep) : NULL;
+		case '*':
+			return max_expand(ms, s, p, ep);
+		case '-':
+			return min_expand(ms, s, p, ep);
+		default:
+			if (!matched)
+				return NULL;
+			++s;
+			p = ep;
+			continue;
+		}
+	}
+	return s;
+}
+
+Pattern pattern_compile(char const *src, size_t length) {
+	Pattern const unsupported = {.kind = PATTERN_UNSUPPORTED};
+	Pattern result = {0};
+	char const *p = src;
+	char const *const end = src + length;
+
+	if (p < end && *p == '^') {
+		result.anchored_start = true;
+		++p;
+	}
+	result.body = p;
+	result.body_length = (uint32_t)(end - p);
+
+	bool literal = true;
+	int depth = 0;
+	while (p < end) {
+		switch (*p) {
+		case '(':
+			++depth;
+			++p;
+			literal = false;
+			continue;
+		case ')':
+			if (--depth < 0)
+				return unsupported;
+			++p;
+			literal = false;
+			continue;
+		case '$':
+			if (p + 1 == end) {
+				result.anchored_end = true;
+				++p;
+				continue;
+			}
+			break;
+		case '%':
+			if (p + 1 >= end)
+				return unsupported;
+			if (p[1] == 'b') {
+				if (end - p < 4)
+					return unsupported;
+				p += 4;
+				literal = false;
+				continue;
+			}
+			if (p[1] == 'f') {
+				p += 2;
+				if (p >= end || *p != '[')
+					return unsupported;
+				p = class_end(p, end);
+				if (!p)
+					return unsupported;
+				literal = false;
+				continue;
+			}
+			// back references need to know what was captured
+			if (isdigit((unsigned char)p[1]))
+				return unsupported;
+			break;
+		}
+
+		char const *ep = class_end(p, end);
+		if (!ep)
+			return unsupported;
+		if (ep - p != 1 || *p == '\0' || strchr(specials, *p))
+			literal = false;
+		if (ep < end && *ep != '\0' && strchr("*+-?", *ep)) {
+			literal = false;
+			++ep;
+		}
+		p = ep;
+	}
+	if (depth != 0)
+		return unsupported;
+
+	if (literal) {
+		result.kind = PATTERN_LITERAL;
+		if (result.anchored_end)
+			result.body_length -= 1;
+	} else {
+		result.kind = PATTERN_GENERAL;
+	}
+	return result;
+}
+
+bool pattern_matches(Pattern const *pat, char const *subject, size_t length) {
+	switch (pat->kind) {
+	case PATTERN_UNSUPPORTED:
+		return false;
+
+	case PATTERN_LITERAL: {
+		size_t const n = pat->body_length;
+		if (n > length)
+			return false;
+		if (n == 0)
+			return !(pat->anchored_start && pat->anchored_end) || length == 0;
+		if (pat->anchored_start && pat->anchored_end)
+			return length == n && memcmp(subject, pat->body, n) == 0;
+		if (pat->anchored_start)
+			return memcmp(subject, pat->body, n) == 0;
+		if (pat->anchored_end)
+			return memcmp(subject + length - n, pat->body, n) == 0;
+		return bytes_contain(subject, length, pat->body, n);
+	}
+
+	case PATTERN_GENERAL: {
+		MatchState const ms = {
+			.src_start = subject,
+			.src_end = subject + length,
+			.pat_end = pat->body + pat->body_length,
+		};
+		char const *s = subject;
+		do {
+			if (do_match(&ms, s, pat->body))
+				return true;
+		} while (s++ < ms.src_end && !pat->anchored_start);
+		return false;
+	}
+	}
+	return false;
+}
+
+bool bytes_contain(char const *haystack, size_t haystack_length, char const *needle, size_t needle_length) {
+	if (needle_length == 0)
+		return true;
+	if (needle_length > haystack_length)
+		return false;
+	char const *p = haystack;
+	char const *const last = haystack + (haystack_length - needle_length);
+	while (p <= last) {
+		p = memchr(p, needle[0], (size_t)(last - p) + 1);
+		if (!p)
+			return false;
+		if (memcmp(p + 1, needle + 1, needle_length - 1) == 0)
+			return true;
+		++p;
+	}
+	return false;
+}
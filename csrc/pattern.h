@@ -0,0 +1,45 @@
+#ifndef LTREESITTER_PATTERN_H
+#define LTREESITTER_PATTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A small matcher for Lua patterns, used to evaluate the built in match?
+// family of query predicates against source bytes without creating Lua
+// strings or calling string.match
+//
+// Only whether a pattern matches is computed, so captures are treated as
+// no-ops. Patterns that need capture information (back references like %1)
+// or that are malformed are reported as unsupported and should be handed to
+// Lua so that the result (or error) is exactly what string.match would give.
+
+typedef enum {
+	PATTERN_UNSUPPORTED,
+	// no special characters, matched with plain byte comparisons
+	PATTERN_LITERAL,
+	PATTERN_GENERAL,
+} PatternKind;
+
+typedef struct {
+	PatternKind kind;
+	bool anchored_start;
+	bool anchored_end; // only used by PATTERN_LITERAL
+	// Points into the source of the pattern, which must outlive this
+	// For PATTERN_LITERAL this is just the literal bytes
+	char const *body;
+	uint32_t body_length;
+} Pattern;
+
+// Analyze a pattern once so it may be matched many times
+// `src` is not copied
+Pattern pattern_compile(char const *src, size_t length);
+
+// Same result as `string.match(subject, pattern) ~= nil`
+// Must not be called with a PATTERN_UNSUPPORTED pattern
+bool pattern_matches(Pattern const *, char const *subject, size_t length);
+
+// Same result as `string.find(haystack, needle, 1, true) ~= nil`
+bool bytes_contain(char const *haystack, size_t haystack_length, char const *needle, size_t needle_length);
+
+#endif
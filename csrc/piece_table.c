@@ -0,0 +1,485 @@
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoding.h"
+#include "luautils.h"
+#include "object.h"
+#include "piece_table.h"
+
+// Append only storage for text, never moved so pieces and snapshots can point into it
+struct TextBlock {
+	TextBlock *next;
+
+	// sorted offsets of every '\n' in `data`, for counting rows without rescanning text
+	uint32_t *newlines;
+	uint32_t newline_count, newline_capacity;
+
+	uint32_t length, capacity;
+	char data[];
+};
+
+#define MIN_BLOCK_CAPACITY 4096
+#define MAX_BLOCK_CAPACITY (1024 * 1024)
+
+static TextBlock *block_new(uint32_t capacity) {
+	TextBlock *const b = malloc(sizeof(TextBlock) + capacity);
+	if (!b)
+		return NULL;
+	*b = (TextBlock){.capacity = capacity};
+	return b;
+}
+
+static void block_free(TextBlock *b) {
+	free(b->newlines);
+	free(b);
+}
+
+// Append text to the block, which must have room for it
+// On failure the block is left as it was
+static bool block_append(TextBlock *b, char const *text, uint32_t len) {
+	uint32_t const initial_newline_count = b->newline_count;
+	for (uint32_t i = 0; i < len; ++i) {
+		if (text[i] != '\n')
+			continue;
+		if (b->newline_count >= b->newline_capacity) {
+			uint32_t const new_cap = b->newline_capacity ? b->newline_capacity * 2 : 16;
+			uint32_t *const newlines = realloc(b->newlines, sizeof(uint32_t) * new_cap);
+			if (!newlines) {
+				b->newline_count = initial_newline_count;
+				return false;
+			}
+			b->newlines = newlines;
+			b->newline_capacity = new_cap;
+		}
+		b->newlines[b->newline_count++] = b->length + i;
+	}
+	memcpy(b->data + b->length, text, len);
+	b->length += len;
+	return true;
+}
+
+// index of the first newline at or after `offset`
+static uint32_t block_newline_lower_bound(TextBlock const *b, uint32_t offset) {
+	uint32_t lo = 0, hi = b->newline_count;
+	while (lo < hi) {
+		uint32_t const mid = lo + (hi - lo) / 2;
+		if (b->newlines[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Move `point` over the block's bytes from `start` to `end`
+static void block_advance_point(TextBlock const *b, uint32_t start, uint32_t end, TSPoint *point) {
+	uint32_t const first = block_newline_lower_bound(b, start);
+	uint32_t const last = block_newline_lower_bound(b, end);
+	if (first == last) {
+		point->column += end - start;
+		return;
+	}
+	point->row += last - first;
+	point->column = end - (b->newlines[last - 1] + 1);
+}
+
+static bool piece_table_reserve_pieces(PieceTable *pt, uint32_t n) {
+	if (pt->piece_capacity >= n)
+		return true;
+	uint32_t new_cap = pt->piece_capacity ? pt->piece_capacity : 8;
+	while (new_cap < n)
+		new_cap *= 2;
+	Piece *const pieces = realloc(pt->pieces, sizeof(Piece) * new_cap);
+	if (!pieces)
+		return false;
+	pt->pieces = pieces;
+	pt->piece_capacity = new_cap;
+	return true;
+}
+
+// Copy text into a block, returning where it was put, or NULL if allocation failed
+static TextBlock *piece_table_store(PieceTable *pt, char const *text, uint32_t len, uint32_t *start) {
+	TextBlock *b = pt->blocks;
+	if (!b || b->capacity - b->length < len) {
+		uint32_t cap = b ? b->capacity * 2 : MIN_BLOCK_CAPACITY;
+		if (cap > MAX_BLOCK_CAPACITY)
+			cap = MAX_BLOCK_CAPACITY;
+		if (cap < len)
+			cap = len;
+		b = block_new(cap);
+		if (!b)
+			return NULL;
+		b->next = pt->blocks;
+		pt->blocks = b;
+	}
+	*start = b->length;
+	if (!block_append(b, text, len))
+		return NULL;
+	return b;
+}
+
+// Find the piece containing `byte` (or the piece count if `byte` is the end of the text)
+// and the point at `byte`
+static uint32_t piece_table_locate(PieceTable const *pt, uint32_t byte, uint32_t *offset_in_piece, TSPoint *point) {
+	*point = (TSPoint){0, 0};
+	uint32_t piece_start = 0;
+	for (uint32_t i = 0; i < pt->piece_count; ++i) {
+		Piece const *const p = &pt->pieces[i];
+		if (byte < piece_start + p->length) {
+			*offset_in_piece = byte - piece_start;
+			block_advance_point(p->block, p->start, p->start + *offset_in_piece, point);
+			return i;
+		}
+		block_advance_point(p->block, p->start, p->start + p->length, point);
+		piece_start += p->length;
+	}
+	*offset_in_piece = 0;
+	return pt->piece_count;
+}
+
+// Make sure a piece starts at `byte`, returning its index
+// There must be room for one more piece
+static uint32_t piece_table_split(PieceTable *pt, uint32_t byte) {
+	uint32_t offset;
+	TSPoint point;
+	uint32_t const i = piece_table_locate(pt, byte, &offset, &point);
+	if (offset == 0)
+		return i;
+	memmove(&pt->pieces[i + 2], &pt->pieces[i + 1], sizeof(Piece) * (pt->piece_count - i - 1));
+	Piece *const p = &pt->pieces[i];
+	pt->pieces[i + 1] = (Piece){
+		.block = p->block,
+		.start = p->start + offset,
+		.length = p->length - offset,
+	};
+	p->length = offset;
+	pt->piece_count += 1;
+	return i + 1;
+}
+
+/* @teal-export piece_table: function(text?: string): PieceTable [[
+   Create a new piece table, an editable document that can be parsed with <code>Parser.parse_piece_table</code>
+
+   Edits only touch the inserted text and a small array of pieces, rather than copying the whole document like editing a string would
+]] */
+int piece_table_new(lua_State *L) {
+	size_t len = 0;
+	char const *text = luaL_optlstring(L, 1, "", &len);
+	luaL_argcheck(L, len <= UINT32_MAX, 1, "text is too long");
+
+	PieceTable *const pt = lua_newuserdata(L, sizeof(PieceTable));
+	*pt = (PieceTable){0};
+	setmetatable(L, LTREESITTER_PIECE_TABLE_METATABLE_NAME);
+
+	if (len == 0)
+		return 1;
+
+	TextBlock *const original = block_new((uint32_t)len);
+	if (!original)
+		return ALLOC_FAIL(L);
+	pt->blocks = original;
+	if (!block_append(original, text, (uint32_t)len) || !piece_table_reserve_pieces(pt, 1))
+		return ALLOC_FAIL(L);
+	pt->pieces[0] = (Piece){.block = original, .start = 0, .length = (uint32_t)len};
+	pt->piece_count = 1;
+	pt->length = (uint32_t)len;
+	return 1;
+}
+
+static int piece_table_gc(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	for (TextBlock *b = pt->blocks; b;) {
+		TextBlock *const next = b->next;
+		block_free(b);
+		b = next;
+	}
+	free(pt->pieces);
+	*pt = (PieceTable){0};
+	return 0;
+}
+
+static uint32_t check_byte(lua_State *L, PieceTable const *pt, int idx) {
+	lua_Integer const byte = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, byte >= 0 && byte <= (lua_Integer)pt->length, idx, "byte index out of range");
+	return (uint32_t)byte;
+}
+
+// ( -- integer * 9 )
+// Replace the bytes from `start` to `end` with `text`, pushing the arguments to Tree:edit for it
+static int piece_table_splice(lua_State *L, PieceTable *pt, uint32_t start, uint32_t end, char const *text, size_t len) {
+	if (len > UINT32_MAX - (pt->length - (end - start)))
+		return luaL_error(L, "Piece table would be too long");
+
+	uint32_t offset;
+	TSPoint start_point, old_end_point;
+	piece_table_locate(pt, start, &offset, &start_point);
+	piece_table_locate(pt, end, &offset, &old_end_point);
+
+	// reserve room for both splits and the inserted piece up front, so a failure
+	// can only happen before the text has changed
+	if (!piece_table_reserve_pieces(pt, pt->piece_count + 3))
+		return ALLOC_FAIL(L);
+
+	// consecutive typing at the end of the last insertion just extends its piece
+	uint32_t const i = piece_table_split(pt, start);
+	Piece *const prev = i > 0 ? &pt->pieces[i - 1] : NULL;
+	bool const extends_prev = len > 0
+		&& prev
+		&& prev->block == pt->blocks
+		&& prev->start + prev->length == prev->block->length
+		&& prev->block->capacity - prev->block->length >= len;
+
+	Piece inserted = {0};
+	if (len > 0) {
+		inserted.length = (uint32_t)len;
+		inserted.block = piece_table_store(pt, text, (uint32_t)len, &inserted.start);
+		if (!inserted.block)
+			return ALLOC_FAIL(L);
+	}
+
+	uint32_t const j = piece_table_split(pt, end);
+	if (extends_prev) {
+		prev->length += (uint32_t)len;
+		memmove(&pt->pieces[i], &pt->pieces[j], sizeof(Piece) * (pt->piece_count - j));
+		pt->piece_count -= j - i;
+	} else {
+		uint32_t const added = len > 0 ? 1 : 0;
+		memmove(&pt->pieces[i + added], &pt->pieces[j], sizeof(Piece) * (pt->piece_count - j));
+		if (added)
+			pt->pieces[i] = inserted;
+		pt->piece_count = pt->piece_count - (j - i) + added;
+	}
+	pt->length = pt->length - (end - start) + (uint32_t)len;
+
+	TSPoint const new_end_point = advance_point(start_point, text, (uint32_t)len, TSInputEncodingUTF8);
+
+	pushinteger(L, start);
+	pushinteger(L, end);
+	pushinteger(L, start + (uint32_t)len);
+	pushinteger(L, start_point.row);
+	pushinteger(L, start_point.column);
+	pushinteger(L, old_end_point.row);
+	pushinteger(L, old_end_point.column);
+	pushinteger(L, new_end_point.row);
+	pushinteger(L, new_end_point.column);
+	return 9;
+}
+
+/* @teal-export PieceTable.insert: function(PieceTable, byte: integer, text: string): integer, integer, integer, integer, integer, integer, integer, integer, integer [[
+   Insert <code>text</code> at the given (0-based) byte offset
+
+   Returns the arguments <code>Tree:edit</code> expects for this edit, so a tree parsed from this table can be updated with
+   <code>tree:edit(pt:insert(byte, text))</code>. Points are computed as utf-8, with columns in bytes
+]] */
+static int piece_table_insert(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	uint32_t const byte = check_byte(L, pt, 2);
+	size_t len;
+	char const *text = luaL_checklstring(L, 3, &len);
+	return piece_table_splice(L, pt, byte, byte, text, len);
+}
+
+/* @teal-export PieceTable.delete: function(PieceTable, start_byte: integer, end_byte: integer): integer, integer, integer, integer, integer, integer, integer, integer, integer [[
+   Delete the text from <code>start_byte</code> up to (but not including) <code>end_byte</code>
+
+   Returns the arguments <code>Tree:edit</code> expects for this edit, like <code>PieceTable.insert</code>
+]] */
+static int piece_table_delete(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	uint32_t const start = check_byte(L, pt, 2);
+	uint32_t const end = check_byte(L, pt, 3);
+	luaL_argcheck(L, start <= end, 3, "end_byte is before start_byte");
+	return piece_table_splice(L, pt, start, end, "", 0);
+}
+
+/* @teal-export PieceTable.replace: function(PieceTable, start_byte: integer, end_byte: integer, text: string): integer, integer, integer, integer, integer, integer, integer, integer, integer [[
+   Replace the text from <code>start_byte</code> up to (but not including) <code>end_byte</code> with <code>text</code>
+
+   Returns the arguments <code>Tree:edit</code> expects for this edit, like <code>PieceTable.insert</code>
+]] */
+static int piece_table_replace(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	uint32_t const start = check_byte(L, pt, 2);
+	uint32_t const end = check_byte(L, pt, 3);
+	luaL_argcheck(L, start <= end, 3, "end_byte is before start_byte");
+	size_t len;
+	char const *text = luaL_checklstring(L, 4, &len);
+	return piece_table_splice(L, pt, start, end, text, len);
+}
+
+/* @teal-export PieceTable.length: function(PieceTable): integer [[
+   Get the length of the document in bytes
+]] */
+static int piece_table_length(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	pushinteger(L, pt->length);
+	return 1;
+}
+
+// ( -- string )
+static void piece_table_push_range(lua_State *L, PieceTable const *pt, uint32_t start, uint32_t end) {
+	StringBuilder sb = {0};
+	if (!sb_ensure_cap(&sb, end - start))
+		ALLOC_FAIL(L);
+	uint32_t piece_start = 0;
+	for (uint32_t i = 0; i < pt->piece_count && piece_start < end; ++i) {
+		Piece const *const p = &pt->pieces[i];
+		uint32_t const piece_end = piece_start + p->length;
+		if (piece_end > start) {
+			uint32_t const from = start > piece_start ? start - piece_start : 0;
+			uint32_t const to = end < piece_end ? end - piece_start : p->length;
+			sb_push_lstr(&sb, to - from, p->block->data + p->start + from);
+		}
+		piece_start = piece_end;
+	}
+	sb_push_to_lua(L, &sb);
+	sb_free(&sb);
+}
+
+/* @teal-export PieceTable.sub: function(PieceTable, start_byte?: integer, end_byte?: integer): string [[
+   Get the text from <code>start_byte</code> up to (but not including) <code>end_byte</code> as a string
+
+   <code>start_byte</code> defaults to the start of the document and <code>end_byte</code> to the end
+]] */
+static int piece_table_sub(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	uint32_t const start = lua_isnoneornil(L, 2) ? 0 : check_byte(L, pt, 2);
+	uint32_t const end = lua_isnoneornil(L, 3) ? pt->length : check_byte(L, pt, 3);
+	luaL_argcheck(L, start <= end, 3, "end_byte is before start_byte");
+	piece_table_push_range(L, pt, start, end);
+	return 1;
+}
+
+static int piece_table_tostring(lua_State *L) {
+	PieceTable *const pt = piece_table_assert(L, 1);
+	piece_table_push_range(L, pt, 0, pt->length);
+	return 1;
+}
+
+static const luaL_Reg piece_table_methods[] = {
+	{"insert", piece_table_insert},
+	{"delete", piece_table_delete},
+	{"replace", piece_table_replace},
+	{"length", piece_table_length},
+	{"sub", piece_table_sub},
+	{NULL, NULL}};
+static const luaL_Reg piece_table_metamethods[] = {
+	{"__gc", piece_table_gc},
+	{"__tostring", piece_table_tostring},
+	{"__len", piece_table_length},
+	{NULL, NULL}};
+
+PieceTableSnapshot *piece_table_snapshot_push(lua_State *L, int table_idx) {
+	table_idx = absindex(L, table_idx);
+	PieceTable const *const pt = piece_table_assert(L, table_idx);
+
+	// one allocation, laid out as the struct followed by its three arrays
+	uint32_t const n = pt->piece_count;
+	PieceTableSnapshot *const s = lua_newuserdata(
+		L,
+		sizeof(PieceTableSnapshot) + n * (sizeof(char const *) + 2 * sizeof(uint32_t))); // snapshot
+	s->chunks = (char const **)(s + 1);
+	s->chunk_lengths = (uint32_t *)(s->chunks + n);
+	s->chunk_starts = s->chunk_lengths + n;
+	s->chunk_count = n;
+	s->length = pt->length;
+
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		Piece const *const p = &pt->pieces[i];
+		s->chunks[i] = p->block->data + p->start;
+		s->chunk_lengths[i] = p->length;
+		s->chunk_starts[i] = offset;
+		offset += p->length;
+	}
+	setmetatable(L, LTREESITTER_PIECE_TABLE_SNAPSHOT_METATABLE_NAME);
+
+	bind_lifetimes(L, -1, table_idx); // snapshot keeps the table's blocks alive
+	return s;
+}
+
+// index of the chunk containing `byte`, which must be less than the snapshot's length
+static uint32_t snapshot_find_chunk(PieceTableSnapshot const *s, uint32_t byte) {
+	uint32_t lo = 0, hi = s->chunk_count;
+	while (hi - lo > 1) {
+		uint32_t const mid = lo + (hi - lo) / 2;
+		if (s->chunk_starts[mid] <= byte)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+char const *piece_table_snapshot_read(void *payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read) {
+	(void)position;
+	PieceTableSnapshot const *const s = payload;
+	if (byte_index >= s->length) {
+		*bytes_read = 0;
+		return "";
+	}
+	uint32_t const i = snapshot_find_chunk(s, byte_index);
+	uint32_t const offset = byte_index - s->chunk_starts[i];
+	*bytes_read = s->chunk_lengths[i] - offset;
+	return s->chunks[i] + offset;
+}
+
+bool piece_table_snapshot_sub(PieceTableSnapshot const *s, uint32_t start, uint32_t end, MaybeOwnedString *out) {
+	if (end > s->length)
+		end = s->length;
+	if (start >= end) {
+		*out = (MaybeOwnedString){.data = "", .length = 0, .owned = false};
+		return true;
+	}
+
+	uint32_t i = snapshot_find_chunk(s, start);
+	uint32_t offset = start - s->chunk_starts[i];
+	if (end - s->chunk_starts[i] <= s->chunk_lengths[i]) {
+		*out = (MaybeOwnedString){.data = s->chunks[i] + offset, .length = end - start, .owned = false};
+		return true;
+	}
+
+	char *const data = malloc(end - start);
+	if (!data)
+		return false;
+	uint32_t written = 0;
+	while (written < end - start) {
+		uint32_t n = s->chunk_lengths[i] - offset;
+		if (n > end - start - written)
+			n = end - start - written;
+		memcpy(data + written, s->chunks[i] + offset, n);
+		written += n;
+		i += 1;
+		offset = 0;
+	}
+	*out = (MaybeOwnedString){.data = data, .length = written, .owned = true};
+	return true;
+}
+
+// Lets a snapshot be used as a reader function like the ones given to Parser.parse_with
+static int piece_table_snapshot_call(lua_State *L) {
+	PieceTableSnapshot *const s = piece_table_snapshot_assert(L, 1);
+	lua_Integer const byte = luaL_checkinteger(L, 2);
+	if (byte < 0 || byte >= (lua_Integer)s->length) {
+		lua_pushnil(L);
+		return 1;
+	}
+	uint32_t len;
+	char const *const chunk = piece_table_snapshot_read(s, (uint32_t)byte, (TSPoint){0, 0}, &len);
+	lua_pushlstring(L, chunk, len);
+	return 1;
+}
+
+static const luaL_Reg piece_table_snapshot_metamethods[] = {
+	{"__call", piece_table_snapshot_call},
+	{NULL, NULL}};
+
+void piece_table_init_metatables(lua_State *L) {
+	create_metatable(L, LTREESITTER_PIECE_TABLE_METATABLE_NAME, piece_table_metamethods, piece_table_methods);
+	lua_pop(L, 1);
+	create_metatable(L, LTREESITTER_PIECE_TABLE_SNAPSHOT_METATABLE_NAME, piece_table_snapshot_metamethods, NULL);
+	lua_pop(L, 1);
+}
@@ -0,0 +1,62 @@
+#ifndef LTREESITTER_PIECE_TABLE_H
+#define LTREESITTER_PIECE_TABLE_H
+
+#include "luautils.h"
+#include "types.h"
+#include <lua.h>
+#include <tree_sitter/api.h>
+
+// An editable source document stored as a piece table
+//
+// Text is only ever appended to blocks that are never moved or freed until
+// the table is collected, and the document is a sequence of pieces (slices of
+// those blocks). So an edit only touches the piece array and the inserted
+// bytes, and a snapshot of the document is just a copy of the piece array
+// that stays valid as the table is edited further.
+//
+// Trees parsed from a piece table keep a snapshot of it as their reader.
+
+typedef struct TextBlock TextBlock;
+
+typedef struct {
+	TextBlock *block;
+	uint32_t start, length;
+} Piece;
+
+typedef struct {
+	TextBlock *blocks; // newest first
+	Piece *pieces;
+	uint32_t piece_count, piece_capacity;
+	uint32_t length;
+} PieceTable;
+
+typedef struct {
+	char const **chunks;
+	uint32_t *chunk_lengths;
+	uint32_t *chunk_starts; // byte offset of each chunk in the document
+	uint32_t chunk_count;
+	uint32_t length;
+} PieceTableSnapshot;
+
+def_check_assert(PieceTable, piece_table, LTREESITTER_PIECE_TABLE_METATABLE_NAME)
+def_check_assert(PieceTableSnapshot, piece_table_snapshot, LTREESITTER_PIECE_TABLE_SNAPSHOT_METATABLE_NAME)
+
+// ( -- )
+void piece_table_init_metatables(lua_State *L);
+
+// ( ?string -- PieceTable )
+int piece_table_new(lua_State *L);
+
+// ( [table_idx]=PieceTable | -- PieceTableSnapshot )
+// The snapshot keeps the table (and so its blocks) alive
+PieceTableSnapshot *piece_table_snapshot_push(lua_State *L, int table_idx);
+
+// A TSInput.read that serves chunks directly from a snapshot
+char const *piece_table_snapshot_read(void *payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read);
+
+// Get the bytes from `start` to `end`, borrowed from the snapshot when they
+// are all in one piece, otherwise copied
+// Returns false if the copy couldn't be allocated
+bool piece_table_snapshot_sub(PieceTableSnapshot const *, uint32_t start, uint32_t end, MaybeOwnedString *out);
+
+#endif
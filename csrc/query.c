@@ -4,11 +4,13 @@
 #include <string.h>
 #include <tree_sitter/api.h>
 
+#include "encoding.h"
 #include "luautils.h"
 #include "node.h"
 #include "object.h"
 #include "query.h"
 #include "query_cursor.h"
+#include "threads.h"
 #include "tree.h"
 #include "types.h"
 
@@ -73,200 +75,531 @@ bool query_handle_error(
 	return false;
 }
 
-void query_push(lua_State *L, TSQuery *q, int language_index) {
-	*(TSQuery **)lua_newuserdata(L, sizeof(TSQuery *)) = q;
-	setmetatable(L, LTREESITTER_QUERY_METATABLE_NAME);
+// Indexes into the table kept by each query
+enum {
+	QUERY_KEPT_LANGUAGE = 1,
+	// array of every string in the query, indexed by string id + 1
+	QUERY_KEPT_STRINGS,
+	// weak keyed map of user predicate tables to their resolved functions
+	QUERY_KEPT_RESOLVED_BY_TABLE,
+	// resolved functions when no predicate table is given
+	QUERY_KEPT_RESOLVED_DEFAULT,
+	QUERY_KEPT_COUNT = QUERY_KEPT_RESOLVED_DEFAULT,
+};
+
+static bool name_is(char const *name, uint32_t len, char const *lit) {
+	return strlen(lit) == len && memcmp(name, lit, len) == 0;
+}
+
+// Decide whether a predicate can be evaluated natively based on its name and
+// arguments, otherwise it is left to the Lua version (which will also report
+// any errors about the number of arguments)
+static void compile_native_predicate(TSQuery const *q, CompiledPredicate *pred, PredicateArg const *args) {
+	uint32_t name_len;
+	char const *name = ts_query_string_value_for_id(q, pred->name_id, &name_len);
+
+	pred->native = NATIVE_PREDICATE_NONE;
+	if (name_is(name, name_len, "eq?")) {
+		if (pred->arg_count >= 2)
+			pred->native = NATIVE_PREDICATE_EQ;
+	} else if (name_is(name, name_len, "not-eq?")) {
+		if (pred->arg_count >= 2)
+			pred->native = NATIVE_PREDICATE_NOT_EQ;
+	} else if (name_is(name, name_len, "any-of?")) {
+		if (pred->arg_count >= 2)
+			pred->native = NATIVE_PREDICATE_ANY_OF;
+	} else if (name_is(name, name_len, "find?")) {
+		if (pred->arg_count == 2)
+			pred->native = NATIVE_PREDICATE_FIND;
+	} else if (name_is(name, name_len, "match?") || name_is(name, name_len, "lua-match?") || name_is(name, name_len, "not-match?")) {
+		// only patterns known ahead of time are compiled
+		if (pred->arg_count != 2 || args[1].type != PREDICATE_ARG_STRING)
+			return;
+		uint32_t pattern_len;
+		char const *pattern = ts_query_string_value_for_id(q, args[1].value_id, &pattern_len);
+		pred->pattern = pattern_compile(pattern, pattern_len);
+		if (pred->pattern.kind == PATTERN_UNSUPPORTED)
+			return;
+		pred->native = name[0] == 'n'
+			? NATIVE_PREDICATE_NOT_MATCH
+			: NATIVE_PREDICATE_MATCH;
+	}
+}
+
+static bool compile_predicates(ltreesitter_Query *lq) {
+	TSQuery const *const q = lq->query;
+	uint32_t const pattern_count = ts_query_pattern_count(q);
+
+	uint32_t total_predicates = 0;
+	uint32_t total_args = 0;
+	for (uint32_t i = 0; i < pattern_count; ++i) {
+		uint32_t num_steps;
+		TSQueryPredicateStep const *const steps = ts_query_predicates_for_pattern(q, i, &num_steps);
+		uint32_t current_args = 0;
+		for (uint32_t j = 0; j < num_steps; ++j) {
+			if (steps[j].type == TSQueryPredicateStepTypeDone) {
+				total_predicates += 1;
+				if (current_args > 0 && current_args - 1 > lq->max_predicate_args)
+					lq->max_predicate_args = current_args - 1;
+				current_args = 0;
+			} else {
+				total_args += 1;
+				current_args += 1;
+			}
+		}
+	}
+
+	lq->patterns = calloc(pattern_count ? pattern_count : 1, sizeof(PatternPredicates));
+	lq->predicates = calloc(total_predicates ? total_predicates : 1, sizeof(CompiledPredicate));
+	lq->predicate_args = calloc(total_args ? total_args : 1, sizeof(PredicateArg));
+	if (!lq->patterns || !lq->predicates || !lq->predicate_args)
+		return false;
+
+	uint32_t predicate_index = 0;
+	uint32_t arg_index = 0;
+	for (uint32_t i = 0; i < pattern_count; ++i) {
+		uint32_t num_steps;
+		TSQueryPredicateStep const *const steps = ts_query_predicates_for_pattern(q, i, &num_steps);
+		lq->patterns[i].predicate_start = predicate_index;
+
+		// questions first so they can short circuit before any side effects happen
+		for (int want_question = 1; want_question >= 0; --want_question) {
+			uint32_t j = 0;
+			while (j < num_steps) {
+				uint32_t const start = j;
+				while (j < num_steps && steps[j].type != TSQueryPredicateStepTypeDone)
+					++j;
+				uint32_t const end = j++; // skip the Done step
+				if (start == end)
+					continue;
+
+				uint32_t name_len;
+				char const *name = ts_query_string_value_for_id(q, steps[start].value_id, &name_len);
+				bool const is_question = name_len > 0 && name[name_len - 1] == '?';
+				if (is_question != (bool)want_question)
+					continue;
+
+				CompiledPredicate *const pred = &lq->predicates[predicate_index++];
+				pred->name_id = steps[start].value_id;
+				pred->is_question = is_question;
+				pred->arg_start = arg_index;
+				pred->arg_count = end - start - 1;
+				for (uint32_t k = start + 1; k < end; ++k) {
+					lq->predicate_args[arg_index++] = (PredicateArg){
+						.type = steps[k].type == TSQueryPredicateStepTypeCapture
+							? PREDICATE_ARG_CAPTURE
+							: PREDICATE_ARG_STRING,
+						.value_id = steps[k].value_id,
+					};
+				}
+				compile_native_predicate(q, pred, &lq->predicate_args[pred->arg_start]);
+			}
+		}
+
+		lq->patterns[i].predicate_count = predicate_index - lq->patterns[i].predicate_start;
+	}
+	lq->predicate_count = predicate_index;
 
+	return true;
+}
+
+void query_push(lua_State *L, TSQuery *q, int language_index) {
 	language_index = absindex(L, language_index);
-	bind_lifetimes(L, -1, language_index); // query keeps language alive
+	ltreesitter_Query *const lq = lua_newuserdata(L, sizeof(ltreesitter_Query));
+	*lq = (ltreesitter_Query){.query = q};
+	setmetatable(L, LTREESITTER_QUERY_METATABLE_NAME); // query
+
+	if (!compile_predicates(lq))
+		ALLOC_FAIL(L);
+
+	uint32_t const string_count = ts_query_string_count(q);
+	lua_createtable(L, QUERY_KEPT_COUNT, 0); // query, kept
+	lua_pushvalue(L, language_index);
+	lua_rawseti(L, -2, QUERY_KEPT_LANGUAGE);
+
+	lua_createtable(L, string_count, 0); // query, kept, strings
+	for (uint32_t i = 0; i < string_count; ++i) {
+		uint32_t len;
+		char const *str = ts_query_string_value_for_id(q, i, &len);
+		lua_pushlstring(L, str, len);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_rawseti(L, -2, QUERY_KEPT_STRINGS); // query, kept
+
+	newtable_with_mode(L, "k"); // query, kept, resolved by table
+	lua_rawseti(L, -2, QUERY_KEPT_RESOLVED_BY_TABLE);
+
+	bind_lifetimes(L, -2, -1); // query keeps language and predicate cache alive
+	lua_pop(L, 1);             // query
 }
 
 static int query_gc(lua_State *L) {
-	TSQuery *q = *query_assert(L, 1);
-	ts_query_delete(q);
-	return 1;
+	ltreesitter_Query *const lq = query_assert(L, 1);
+	ts_query_delete(lq->query);
+	free(lq->patterns);
+	free(lq->predicates);
+	free(lq->predicate_args);
+	return 0;
 }
 
 static int query_pattern_count(lua_State *L) {
-	TSQuery *q = *query_assert(L, 1);
+	TSQuery *q = query_assert(L, 1)->query;
 	pushinteger(L, ts_query_pattern_count(q));
 	return 1;
 }
 static int query_capture_count(lua_State *L) {
-	TSQuery *q = *query_assert(L, 1);
+	TSQuery *q = query_assert(L, 1)->query;
 	pushinteger(L, ts_query_capture_count(q));
 	return 1;
 }
 static int query_string_count(lua_State *L) {
-	TSQuery *q = *query_assert(L, 1);
+	TSQuery *q = query_assert(L, 1)->query;
 	pushinteger(L, ts_query_string_count(q));
 	return 1;
 }
 
-// the capture table is just a map of @name -> Node
-static void add_capture_to_table(
+// ( [query_idx]=Query, [predicate_table_idx]=?table | -- {function|boolean} )
+// Pushes an array of the functions for each of the query's predicates
+// resolved against the given predicate table and the default predicates.
+// Predicates that could not be found are `false`, and built in predicates
+// that weren't overridden and can be evaluated natively are `true`
+//
+// The result is cached per predicate table
+static void push_resolved_predicates(
 	lua_State *L,
-	int table_index,
+	ltreesitter_Query const *lq,
+	int query_idx,
+	int predicate_table_idx) {
+	bool const predicates_provided = !lua_isnoneornil(L, predicate_table_idx);
+
+	push_kept(L, query_idx); // kept
+	int const kept_idx = lua_gettop(L);
+	if (predicates_provided) {
+		lua_rawgeti(L, kept_idx, QUERY_KEPT_RESOLVED_BY_TABLE); // kept, by_table
+		lua_pushvalue(L, predicate_table_idx);                 // kept, by_table, predicate table
+		lua_rawget(L, -2);                                     // kept, by_table, ?resolved
+	} else {
+		lua_rawgeti(L, kept_idx, QUERY_KEPT_RESOLVED_DEFAULT); // kept, ?resolved
+	}
 
-	char const *key,
-	size_t key_len,
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		lua_createtable(L, lq->predicate_count, 0); // kept, [by_table], resolved
+		int const resolved_idx = lua_gettop(L);
+		lua_rawgeti(L, kept_idx, QUERY_KEPT_STRINGS); // kept, [by_table], resolved, strings
+		push_default_predicate_table(L);             // kept, [by_table], resolved, strings, defaults
+		for (uint32_t i = 0; i < lq->predicate_count; ++i) {
+			lua_rawgeti(L, resolved_idx + 1, lq->predicates[i].name_id + 1); // ..., name
+			bool predicate_found = false;
+			if (predicates_provided) {
+				lua_pushvalue(L, -1);
+				lua_gettable(L, predicate_table_idx); // ..., name, ?function
+				if (lua_isnil(L, -1))
+					lua_pop(L, 1);
+				else
+					predicate_found = true;
+			}
+			if (!predicate_found && lq->predicates[i].native != NATIVE_PREDICATE_NONE) {
+				lua_pushboolean(L, true); // evaluated natively
+			} else if (!predicate_found) {
+				lua_pushvalue(L, -1);
+				lua_rawget(L, resolved_idx + 2); // ..., name, ?function
+				if (lua_isnil(L, -1)) {
+					lua_pop(L, 1);
+					lua_pushboolean(L, false);
+				}
+			}
+			lua_rawseti(L, resolved_idx, i + 1); // ..., name
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 2); // kept, [by_table], resolved
+
+		if (predicates_provided) {
+			lua_pushvalue(L, predicate_table_idx); // kept, by_table, resolved, predicate table
+			lua_pushvalue(L, -2);                  // kept, by_table, resolved, predicate table, resolved
+			lua_rawset(L, -4);                     // kept, by_table, resolved
+		} else {
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, kept_idx, QUERY_KEPT_RESOLVED_DEFAULT); // kept, resolved
+		}
+	}
+
+	lua_replace(L, kept_idx); // resolved, [by_table]
+	lua_settop(L, kept_idx);  // resolved
+}
+
+// Where native predicates get the source of captured nodes from
+typedef struct {
+	// the text of the tree, NULL when it was parsed with a reader function
+	char const *text;
+	TSInputEncoding encoding; // of the tree's text
+	// only used when there is no text, to call the reader
+	lua_State *L;
+	int tree_idx;
+} PredicateSource;
+
+// Get the text of a predicate argument, either a string from the query or the
+// source of the last node captured with the given capture id
+// Returns false if nothing was captured
+static bool native_predicate_arg(
+	PredicateSource const *src,
+	ltreesitter_Query const *lq,
+	TSQueryMatch const *m,
+	PredicateArg arg,
+	MaybeOwnedString *out) {
+	switch (arg.type) {
+	case PREDICATE_ARG_STRING: {
+		uint32_t len;
+		out->data = ts_query_string_value_for_id(lq->query, arg.value_id, &len);
+		out->length = len;
+		out->owned = false;
+		return true;
+	}
+	case PREDICATE_ARG_CAPTURE:
+		for (uint32_t i = m->capture_count; i > 0; --i) {
+			if (m->captures[i - 1].index == arg.value_id) {
+				TSNode const n = m->captures[i - 1].node;
+				if (src->text) {
+					uint32_t const start = ts_node_start_byte(n);
+					*out = (MaybeOwnedString){
+						.owned = false,
+						.data = src->text + start,
+						.length = ts_node_end_byte(n) - start,
+					};
+				} else {
+					*out = node_get_source_in(src->L, src->tree_idx, n);
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+	return false;
+}
+
+// Compare two predicate arguments in the source's encoding
+// Strings from the query are utf-8, so when the tree is utf-16 they are compared
+// with captures a character at a time rather than transcoding either
+static bool native_predicate_args_eq(
+	PredicateSource const *src,
+	PredicateArg arg_a,
+	MaybeOwnedString a,
+	PredicateArg arg_b,
+	MaybeOwnedString b) {
+	if (!encoding_is_utf16(src->encoding) || arg_a.type == arg_b.type)
+		return mos_eq(a, b);
+	bool const big_endian = src->encoding == TSInputEncodingUTF16BE;
+	return arg_a.type == PREDICATE_ARG_CAPTURE
+		? utf16_eq_utf8(a.data, a.length, big_endian, b.data, b.length)
+		: utf16_eq_utf8(b.data, b.length, big_endian, a.data, a.length);
+}
+
+// Like native_predicate_arg, but captures from utf-16 trees are transcoded to utf-8
+// for the predicates that look inside of strings
+// Also returns false if the capture couldn't be transcoded
+static bool native_predicate_arg_utf8(
+	PredicateSource const *src,
+	ltreesitter_Query const *lq,
+	TSQueryMatch const *m,
+	PredicateArg arg,
+	MaybeOwnedString *out) {
+	if (!native_predicate_arg(src, lq, m, arg, out))
+		return false;
+	if (arg.type != PREDICATE_ARG_CAPTURE || !encoding_is_utf16(src->encoding))
+		return true;
+
+	StringBuilder sb = {0};
+	bool const ok = utf16_to_utf8(&sb, out->data, out->length, src->encoding == TSInputEncodingUTF16BE);
+	mos_free(out);
+	if (!ok) {
+		// can't error from a worker thread, so just fail the predicate
+		sb_free(&sb);
+		return false;
+	}
+	*out = (MaybeOwnedString){.data = sb.data, .length = sb.length, .owned = true};
+	return true;
+}
+
+static bool eval_native_predicate(
+	PredicateSource const *src,
+	ltreesitter_Query const *lq,
+	TSQueryMatch const *m,
+	CompiledPredicate const *pred) {
+	PredicateArg const *const args = &lq->predicate_args[pred->arg_start];
+	MaybeOwnedString a = {0};
+	MaybeOwnedString b = {0};
+	bool result = false;
+
+	switch (pred->native) {
+	case NATIVE_PREDICATE_NONE:
+		break;
+
+	case NATIVE_PREDICATE_EQ:
+	case NATIVE_PREDICATE_NOT_EQ:
+		if (native_predicate_arg(src, lq, m, args[0], &a)) {
+			result = true;
+			for (uint32_t i = 1; result && i < pred->arg_count; ++i) {
+				result = native_predicate_arg(src, lq, m, args[i], &b)
+					&& native_predicate_args_eq(src, args[0], a, args[i], b);
+				mos_free(&b);
+			}
+		}
+		if (pred->native == NATIVE_PREDICATE_NOT_EQ)
+			result = !result;
+		break;
+
+	case NATIVE_PREDICATE_ANY_OF:
+		if (native_predicate_arg(src, lq, m, args[0], &a)) {
+			for (uint32_t i = 1; !result && i < pred->arg_count; ++i) {
+				result = native_predicate_arg(src, lq, m, args[i], &b)
+					&& native_predicate_args_eq(src, args[0], a, args[i], b);
+				mos_free(&b);
+			}
+		}
+		break;
+
+	case NATIVE_PREDICATE_MATCH:
+	case NATIVE_PREDICATE_NOT_MATCH:
+		if (native_predicate_arg_utf8(src, lq, m, args[0], &a))
+			result = pattern_matches(&pred->pattern, a.data, a.length);
+		if (pred->native == NATIVE_PREDICATE_NOT_MATCH)
+			result = !result;
+		break;
+
+	case NATIVE_PREDICATE_FIND:
+		if (native_predicate_arg_utf8(src, lq, m, args[0], &a)
+			&& native_predicate_arg_utf8(src, lq, m, args[1], &b))
+			result = bytes_contain(a.data, a.length, b.data, b.length);
+		mos_free(&b);
+		break;
+	}
 
-	int child_index,
-	TSNode value) {
-	lua_pushlstring(L, key, key_len);
-	node_push(L, child_index, value);
-	lua_rawset(L, table_index);
+	mos_free(&a);
+	return result;
 }
 
-static void get_capture_from_table(
+// ( [captures_idx]=?table | -- ?Node )
+// Push the node of the last capture in `m` with the given id, or nil if there
+// isn't one. Nodes are only created for captures that a predicate actually
+// uses, and are cached in a {capture id + 1:Node|false} table at
+// `captures_idx`, which is created on first use
+static void push_predicate_capture(
 	lua_State *L,
-	int table_index,
-	char const *key,
-	size_t key_len) {
-	lua_pushlstring(L, key, key_len);
-	lua_rawget(L, table_index);
+	int tree_idx,
+	TSQueryMatch const *m,
+	int captures_idx,
+	uint32_t capture_id) {
+	if (lua_isnil(L, captures_idx)) {
+		lua_newtable(L);
+		lua_replace(L, captures_idx);
+	}
+	lua_rawgeti(L, captures_idx, capture_id + 1); // ?Node|false
+	if (!lua_isnil(L, -1)) {
+		if (!lua_toboolean(L, -1)) {
+			lua_pop(L, 1);
+			lua_pushnil(L);
+		}
+		return;
+	}
+	lua_pop(L, 1);
+
+	for (uint32_t i = m->capture_count; i > 0; --i) {
+		if (m->captures[i - 1].index == capture_id) {
+			node_push(L, tree_idx, m->captures[i - 1].node); // Node
+			lua_pushvalue(L, -1);                            // Node, Node
+			lua_rawseti(L, captures_idx, capture_id + 1);    // Node
+			return;
+		}
+	}
+	lua_pushboolean(L, false);
+	lua_rawseti(L, captures_idx, capture_id + 1);
+	lua_pushnil(L);
 }
 
-// TODO: this function cannot handle upvalue indexes for query_idx, tree_idx, nor predicate_table_idx
 static bool do_predicates(
 	lua_State *L,
 	int query_idx,
-	TSQuery const *const q,
+	ltreesitter_Query const *const lq,
 	int tree_idx,
 	TSQueryMatch const *const m,
 	int predicate_table_idx) {
 	query_idx = absindex(L, query_idx);
 	tree_idx = absindex(L, tree_idx);
 	predicate_table_idx = absindex(L, predicate_table_idx);
-	bool const predicates_provided = lua_type(L, predicate_table_idx) != LUA_TNIL;
-	bool result = true;
+	PatternPredicates const pattern = lq->patterns[m->pattern_index];
+	if (pattern.predicate_count == 0)
+		return true;
 
+	bool result = true;
 	int const initial_stack_top = lua_gettop(L);
 
-	// store captures as a map of {string:Node} where the keys are the
-	// "@name"s and the values are the matched nodes
-	lua_createtable(L, 0, m->capture_count);
-	int capture_table_index = initial_stack_top + 1;
-	for (uint32_t i = 0; i < m->capture_count; ++i) {
-		TSQueryCapture capture = m->captures[i];
-		uint32_t name_len;
-		char const *name = ts_query_capture_name_for_id(q, capture.index, &name_len);
-
-		add_capture_to_table(L, capture_table_index, name, name_len, tree_idx, capture.node);
-	}
-
-	// {
-	// lua_pushvalue(L, capture_table_index);
-	// lua_setglobal(L, "__captures");
-	// luaL_dostring(L, "print(require'inspect'(__captures))");
-	// }
-
-	uint32_t num_steps;
-	TSQueryPredicateStep const *const predicate_step = ts_query_predicates_for_pattern(q, m->pattern_index, &num_steps);
-
-	{
-		// count the max number of args we need to prep for
-		int current_args = 0;
-		int max_args = 0;
-		for (uint32_t j = 0; j < num_steps; ++j) {
-			switch (predicate_step[j].type) {
-			case TSQueryPredicateStepTypeString:
-			case TSQueryPredicateStepTypeCapture:
-				current_args += 1;
-				break;
-
-			case TSQueryPredicateStepTypeDone:
-				if (current_args > max_args)
-					max_args = current_args;
-				current_args = 0;
+	if (!lua_checkstack(L, lq->max_predicate_args + 5))
+		luaL_error(L, "Internal lua error, unable to handle %d arguments to predicate", (int)lq->max_predicate_args);
+
+	push_resolved_predicates(L, lq, query_idx, predicate_table_idx);
+	int const resolved_idx = initial_stack_top + 1;
+	push_kept(L, query_idx);                // resolved, kept
+	lua_rawgeti(L, -1, QUERY_KEPT_STRINGS); // resolved, kept, strings
+	lua_remove(L, -2);                      // resolved, strings
+	int const strings_idx = resolved_idx + 1;
+	// only created once a predicate that needs a Node is called
+	lua_pushnil(L); // resolved, strings, ?captures
+	int const captures_idx = strings_idx + 1;
+
+	for (uint32_t i = 0; i < pattern.predicate_count; ++i) {
+		uint32_t const predicate_index = pattern.predicate_start + i;
+		CompiledPredicate const *const pred = &lq->predicates[predicate_index];
+
+		lua_rawgeti(L, resolved_idx, predicate_index + 1); // function|boolean
+		if (!lua_toboolean(L, -1)) {
+			uint32_t len;
+			char const *name = ts_query_string_value_for_id(lq->query, pred->name_id, &len);
+			luaL_error(L, "Query doesn't have predicate '%s'", name);
+		}
+		if (lua_type(L, -1) == LUA_TBOOLEAN) {
+			lua_pop(L, 1);
+			ltreesitter_Tree const *const tree = tree_assert(L, tree_idx);
+			PredicateSource const src = {
+				.text = tree->text_or_null_if_function_reader,
+				.encoding = tree->encoding,
+				.L = L,
+				.tree_idx = tree_idx,
+			};
+			if (!eval_native_predicate(&src, lq, m, pred)) {
+				result = false;
 				break;
 			}
+			continue;
 		}
-		if (!lua_checkstack(L, max_args))
-			luaL_error(L, "Internal lua error, unable to handle %d arguments to predicate", max_args);
-	}
 
-	enum {
-		questions,
-		non_questions,
-		end
-	};
-	for (int step = questions; step < end; ++step) {
-		int num_args = 0;
-		bool is_question = false; // if a predicate is a question then the query should only match if it results in a truthy value
-		char const *func_name = NULL;
-		for (uint32_t j = 0; j < num_steps; ++j) {
-			switch (predicate_step[j].type) {
-			case TSQueryPredicateStepTypeString: {
-				// literal strings
-
-				uint32_t len;
-				char const *pred_name = ts_query_string_value_for_id(q, predicate_step[j].value_id, &len);
-				if (!func_name) {
-					bool predicate_found = false;
-					if (predicates_provided) {
-						lua_getfield(L, predicate_table_idx, pred_name);
-						if (lua_isnil(L, -1))
-							lua_pop(L, 1);
-						else
-							predicate_found = true;
-					}
-					if (!predicate_found) {
-						push_default_predicate_table(L);
-						predicate_found = getfield_type(L, -1, pred_name) != LUA_TNIL;
-						lua_remove(L, -2);
-					}
-					if (!predicate_found)
-						luaL_error(L, "Query doesn't have predicate '%s'", pred_name);
-					func_name = pred_name;
-					if (func_name[len - 1] == '?') {
-						is_question = true;
-					}
-
-					if ((step == questions) != is_question) {
-						do j += 1;
-						while (j < num_steps && predicate_step[j].type != TSQueryPredicateStepTypeDone);
-						num_args = 0;
-						func_name = NULL;
-						is_question = false;
-						continue;
-					}
-				} else {
-					lua_pushlstring(L, pred_name, len);
-					++num_args;
-				}
+		for (uint32_t j = 0; j < pred->arg_count; ++j) {
+			PredicateArg const arg = lq->predicate_args[pred->arg_start + j];
+			switch (arg.type) {
+			case PREDICATE_ARG_STRING:
+				lua_rawgeti(L, strings_idx, arg.value_id + 1);
 				break;
-			}
-			case TSQueryPredicateStepTypeCapture: {
-				uint32_t len;
-				char const *name = ts_query_capture_name_for_id(q, predicate_step[j].value_id, &len);
-				get_capture_from_table(L, capture_table_index, name, len);
-				++num_args;
-
+			case PREDICATE_ARG_CAPTURE:
+				push_predicate_capture(L, tree_idx, m, captures_idx, arg.value_id);
 				break;
 			}
-			case TSQueryPredicateStepTypeDone:
-				if (lua_pcall(L, num_args, 1, 0) != LUA_OK) {
-					lua_pushfstring(L, "Error calling predicate '%s': ", func_name);
-					lua_insert(L, -2);
-					lua_concat(L, 2);
-					lua_error(L);
-				}
+		}
 
-				if (is_question && !lua_toboolean(L, -1)) {
-					result = false;
-					goto break_predicate_loop;
-				}
+		if (lua_pcall(L, pred->arg_count, 1, 0) != LUA_OK) {
+			uint32_t len;
+			char const *name = ts_query_string_value_for_id(lq->query, pred->name_id, &len);
+			lua_pushfstring(L, "Error calling predicate '%s': ", name);
+			lua_insert(L, -2);
+			lua_concat(L, 2);
+			lua_error(L);
+		}
 
-				num_args = 0;
-				func_name = NULL;
-				is_question = false;
-				break;
-			}
+		if (pred->is_question && !lua_toboolean(L, -1)) {
+			result = false;
+			break;
 		}
+		lua_pop(L, 1);
 	}
 
-break_predicate_loop:
 	lua_settop(L, initial_stack_top);
 	return result;
 }
@@ -283,8 +616,11 @@ break_predicate_loop:
 static int query_iterator_next_match(lua_State *L) {
 	// upvalues: Query, Node, Predicate Map, Cursor
 	int const initial_query_idx = lua_upvalueindex(1);
-	TSQuery *const q = *query_assert(L, initial_query_idx);
+	ltreesitter_Query *const lq = query_assert(L, initial_query_idx);
+	TSQuery *const q = lq->query;
 	TSQueryCursor *c = *query_cursor_assert(L, lua_upvalueindex(4));
+	if (!c)
+		return 0; // already exhausted
 	TSQueryMatch m;
 	node_push_tree(L, lua_upvalueindex(2));
 	int const tree_index = lua_gettop(L);
@@ -296,9 +632,11 @@ static int query_iterator_next_match(lua_State *L) {
 	int const predicate_table_index = lua_gettop(L);
 
 	do {
-		if (!ts_query_cursor_next_match(c, &m))
+		if (!ts_query_cursor_next_match(c, &m)) {
+			query_cursor_release_early(L, lua_upvalueindex(4));
 			return 0;
-	} while (!do_predicates(L, query_idx, q, tree_index, &m, predicate_table_index));
+		}
+	} while (!do_predicates(L, query_idx, lq, tree_index, &m, predicate_table_index));
 
 	push_match(L, m, q, tree_index);
 	return 1;
@@ -307,8 +645,11 @@ static int query_iterator_next_match(lua_State *L) {
 static int query_iterator_next_capture(lua_State *L) {
 	// upvalues: Query, Node, Predicate Map, Cursor
 	int const initial_query_idx = lua_upvalueindex(1);
-	TSQuery *const q = *query_assert(L, initial_query_idx);
+	ltreesitter_Query *const lq = query_assert(L, initial_query_idx);
+	TSQuery *const q = lq->query;
 	TSQueryCursor *c = *query_cursor_assert(L, lua_upvalueindex(4));
+	if (!c)
+		return 0; // already exhausted
 	node_push_tree(L, lua_upvalueindex(2));
 	int const tree_index = lua_gettop(L);
 	TSQueryMatch m;
@@ -320,9 +661,11 @@ static int query_iterator_next_capture(lua_State *L) {
 	int const predicate_table_idx = lua_gettop(L);
 
 	do {
-		if (!ts_query_cursor_next_capture(c, &m, &capture_index))
+		if (!ts_query_cursor_next_capture(c, &m, &capture_index)) {
+			query_cursor_release_early(L, lua_upvalueindex(4));
 			return 0;
-	} while (!do_predicates(L, query_idx, q, tree_index, &m, predicate_table_idx));
+		}
+	} while (!do_predicates(L, query_idx, lq, tree_index, &m, predicate_table_idx));
 
 	node_push(
 		L, tree_index,
@@ -334,25 +677,81 @@ static int query_iterator_next_capture(lua_State *L) {
 	return 2;
 }
 
-static void query_cursor_set_range(lua_State *L, TSQueryCursor *c) {
-	if (lua_isnumber(L, 4)) {
+static int query_iterator_next_capture_range(lua_State *L) {
+	// upvalues: Query, Node, Predicate Map, Cursor
+	int const initial_query_idx = lua_upvalueindex(1);
+	ltreesitter_Query *const lq = query_assert(L, initial_query_idx);
+	TSQueryCursor *c = *query_cursor_assert(L, lua_upvalueindex(4));
+	if (!c)
+		return 0; // already exhausted
+	node_push_tree(L, lua_upvalueindex(2));
+	int const tree_index = lua_gettop(L);
+	TSQueryMatch m;
+	uint32_t capture_index;
+	lua_pushvalue(L, initial_query_idx);
+	int const query_idx = lua_gettop(L);
+
+	lua_pushvalue(L, lua_upvalueindex(3));
+	int const predicate_table_idx = lua_gettop(L);
+
+	do {
+		if (!ts_query_cursor_next_capture(c, &m, &capture_index)) {
+			query_cursor_release_early(L, lua_upvalueindex(4));
+			return 0;
+		}
+	} while (!do_predicates(L, query_idx, lq, tree_index, &m, predicate_table_idx));
+
+	TSQueryCapture const capture = m.captures[capture_index];
+	TSPoint const start = ts_node_start_point(capture.node);
+	TSPoint const end = ts_node_end_point(capture.node);
+	pushinteger(L, capture.index + 1);
+	pushinteger(L, ts_node_start_byte(capture.node));
+	pushinteger(L, ts_node_end_byte(capture.node));
+	pushinteger(L, start.row);
+	pushinteger(L, start.column);
+	pushinteger(L, end.row);
+	pushinteger(L, end.column);
+	return 7;
+}
+
+// ( [start_idx]=?(integer|Point), [start_idx + 1]=?(integer|Point) | -- QueryCursor )
+// Get a cursor from the pool and apply the range given by the arguments at
+// `start_idx` and `start_idx + 1` to it
+static TSQueryCursor *push_query_cursor_with_range(lua_State *L, int start_idx) {
+	int const end_idx = start_idx + 1;
+	TSQueryCursor *const c = query_cursor_push(L); // cursor
+	int const cursor_idx = lua_gettop(L);
+
+	if (lua_isnumber(L, start_idx)) {
 		ts_query_cursor_set_byte_range(
 			c,
-			luaL_checkinteger(L, 4),
-			luaL_checkinteger(L, 5));
-	} else {
-		luaL_argcheck(L, lua_type(L, 4) == LUA_TTABLE, 4, "expected number or table");
-		luaL_argcheck(L, lua_type(L, 5) == LUA_TTABLE, 5, "expected table");
-		expect_field(L, 4, "row", LUA_TNUMBER);
-		expect_field(L, 4, "column", LUA_TNUMBER);
-		expect_field(L, 5, "row", LUA_TNUMBER);
-		expect_field(L, 5, "column", LUA_TNUMBER);
+			luaL_checkinteger(L, start_idx),
+			luaL_checkinteger(L, end_idx));
+	} else if (!lua_isnoneornil(L, start_idx)) {
+		luaL_argcheck(L, lua_type(L, start_idx) == LUA_TTABLE, start_idx, "expected number or table");
+		luaL_argcheck(L, lua_type(L, end_idx) == LUA_TTABLE, end_idx, "expected table");
+		expect_field(L, start_idx, "row", LUA_TNUMBER);
+		expect_field(L, start_idx, "column", LUA_TNUMBER);
+		expect_field(L, end_idx, "row", LUA_TNUMBER);
+		expect_field(L, end_idx, "column", LUA_TNUMBER);
 
 		ts_query_cursor_set_point_range(
 			c,
-			(TSPoint){.row = lua_tointeger(L, 6), .column = lua_tointeger(L, 7)},
-			(TSPoint){.row = lua_tointeger(L, 8), .column = lua_tointeger(L, 9)});
+			(TSPoint){.row = lua_tointeger(L, -4), .column = lua_tointeger(L, -3)},
+			(TSPoint){.row = lua_tointeger(L, -2), .column = lua_tointeger(L, -1)});
+		lua_settop(L, cursor_idx);
 	}
+
+	return c;
+}
+
+// ( Query, Node, ?predicates, ?start, ?end -- Query, Node, ?predicates, QueryCursor )
+static TSQueryCursor *replace_range_args_with_cursor(lua_State *L) {
+	lua_settop(L, 5);
+	TSQueryCursor *const c = push_query_cursor_with_range(L, 4);
+	lua_replace(L, 4); // query, node, predicates, cursor, end
+	lua_settop(L, 4);  // query, node, predicates, cursor
+	return c;
 }
 
 /* @teal-export Query.match: function(Query, Node, predicates?: {string:Predicate}, start?: integer | Point, end_?: integer | Point): function(): Match [[
@@ -393,10 +792,18 @@ static void query_cursor_set_range(lua_State *L, TSQueryCursor *c) {
 
    Additionally, you will not have access to the return values of these functions, if you'd like to keep the results of a computation, make your functions have side-effects to write somewhere you can access.
 
+   The functions in a <code>predicates</code> table are looked up once, the first time that table is used with a query, and cached. So adding or replacing functions in a table that has already been used will not be noticed, use a new table instead.
+
    By default the following predicates are provided.
       <code> (#eq? ...) </code> will match if all arguments provided are equal
       <code> (#match? text pattern) </code> will match the provided <code>text</code> matches the given <code>pattern</code>. Matches are determined by Lua's standard <code>string.match</code> function.
       <code> (#find? text substring) </code> will match if <code>text</code> contains <code>substring</code>. The substring is found with Lua's standard <code>string.find</code>, but the search always starts from the beginning, and pattern matching is disabled. This is equivalent to <code>string.find(text, substring, 0, true)</code>
+      <code> (#not-eq? ...) </code> will match if the arguments provided are not all equal
+      <code> (#any-of? text ...) </code> will match if <code>text</code> is equal to any of the other arguments
+      <code> (#lua-match? text pattern) </code> is the same as <code>match?</code>
+      <code> (#not-match? text pattern) </code> will match if <code>text</code> does not match the given <code>pattern</code>
+
+   These are evaluated directly against the source of the tree without calling into Lua, unless <code>predicates</code> provides a function with the same name.
 
    Predicate evaluation order:
 
@@ -435,15 +842,9 @@ static void query_cursor_set_range(lua_State *L, TSQueryCursor *c) {
    </pre>
 ]]*/
 static int query_match_factory(lua_State *L) {
-	TSQuery *const q = *query_assert(L, 1);
+	TSQuery *const q = query_assert(L, 1)->query;
 	TSNode n = *node_assert(L, 2);
-	TSQueryCursor *c = ts_query_cursor_new();
-	if (lua_gettop(L) > 3)
-		query_cursor_set_range(L, c);
-	lua_settop(L, 3);
-	TSQueryCursor **lc = lua_newuserdata(L, sizeof(TSQueryCursor *));
-	setmetatable(L, LTREESITTER_QUERY_CURSOR_METATABLE_NAME);
-	*lc = c;
+	TSQueryCursor *const c = replace_range_args_with_cursor(L);
 	ts_query_cursor_exec(c, q, n);
 	lua_pushcclosure(L, query_iterator_next_match, 4);
 	return 1;
@@ -464,20 +865,55 @@ static int query_match_factory(lua_State *L) {
    </pre>
 ]]*/
 static int query_capture_factory(lua_State *L) {
-	TSQuery *const q = *query_assert(L, 1);
+	TSQuery *const q = query_assert(L, 1)->query;
 	TSNode n = *node_assert(L, 2);
-	TSQueryCursor *c = ts_query_cursor_new();
-	if (lua_gettop(L) > 3)
-		query_cursor_set_range(L, c);
-	lua_settop(L, 3);
-	TSQueryCursor **lc = lua_newuserdata(L, sizeof(TSQueryCursor *));
-	setmetatable(L, LTREESITTER_QUERY_CURSOR_METATABLE_NAME);
-	*lc = c;
+	TSQueryCursor *const c = replace_range_args_with_cursor(L);
 	ts_query_cursor_exec(c, q, n);
 	lua_pushcclosure(L, query_iterator_next_capture, 4); // prevent the node + query from being gc'ed
 	return 1;
 }
 
+/* @teal-export Query.capture_ranges: function(Query, Node, predicates?: {string:Predicate}, start?: integer | Point, end_?: integer | Point): function(): (integer, integer, integer, integer, integer, integer, integer) [[
+   Iterate over the captures of a given query like <code>Query.capture</code>, but rather than a <code>Node</code> and its name, only integers describing each capture are returned:
+   <code>capture_index, start_byte, end_byte, start_row, start_column, end_row, end_column</code>
+
+   <code>capture_index</code> is the index of the capture's name in the array returned by <code>Query.capture_names</code>.
+   Byte offsets, rows, and columns are the same as those returned by <code>Node.start_byte_offset</code>, <code>Node.end_byte_offset</code>, <code>Node.start_point</code>, and <code>Node.end_point</code>.
+
+   Since no Nodes or strings are created (unless a predicate implemented in Lua needs them), this is the cheapest way to iterate over the captures of a query.
+
+   <pre>
+   local names = q:capture_names()
+   for index, start_byte, end_byte in q:capture_ranges(node) do
+      print(names[index], start_byte, end_byte)
+   end
+   </pre>
+]]*/
+static int query_capture_ranges_factory(lua_State *L) {
+	TSQuery *const q = query_assert(L, 1)->query;
+	TSNode n = *node_assert(L, 2);
+	TSQueryCursor *const c = replace_range_args_with_cursor(L);
+	ts_query_cursor_exec(c, q, n);
+	lua_pushcclosure(L, query_iterator_next_capture_range, 4);
+	return 1;
+}
+
+/* @teal-export Query.capture_names: function(Query): {string} [[
+   Get the names of each capture in the query, in the order of their indexes. (Without the leading <code>@</code>)
+]] */
+static int query_capture_names(lua_State *L) {
+	TSQuery const *const q = query_assert(L, 1)->query;
+	uint32_t const count = ts_query_capture_count(q);
+	lua_createtable(L, count, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t len;
+		char const *name = ts_query_capture_name_for_id(q, i, &len);
+		lua_pushlstring(L, name, len);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
 /* @teal-inline [[
    type Predicate = function(...: string | Node | {Node}): any...
 ]] */
@@ -517,25 +953,344 @@ static int query_capture_factory(lua_State *L) {
    If you'd like to interact with the matches/captures of a query, see the Query.match and Query.capture iterators
 ]]*/
 static int query_exec(lua_State *L) {
-	TSQuery *const q = *query_assert(L, 1);
+	ltreesitter_Query *const lq = query_assert(L, 1);
 	TSNode n = *node_assert(L, 2);
 
-	TSQueryCursor *c = ts_query_cursor_new();
-	if (lua_gettop(L) > 3)
-		query_cursor_set_range(L, c);
+	// kept on the stack so the cursor goes back to the pool even if a predicate errors
+	TSQueryCursor *const c = replace_range_args_with_cursor(L);
 
 	node_push_tree(L, 2);
 	int const parent_idx = absindex(L, -1);
 
 	TSQueryMatch m;
-	ts_query_cursor_exec(c, q, n);
+	ts_query_cursor_exec(c, lq->query, n);
 	while (ts_query_cursor_next_match(c, &m)) {
-		do_predicates(L, 1, q, parent_idx, &m, 3);
+		do_predicates(L, 1, lq, parent_idx, &m, 3);
 	}
 
+	query_cursor_release_early(L, 4);
 	return 0;
 }
 
+/* @teal-export Query.matches_into: function(Query, Node, out: {Match}, max?: integer, predicates?: {string:Predicate}, start?: integer | Point, end_?: integer | Point): integer [[
+   Run a query and write its matches into <code>out[1]</code>, <code>out[2]</code>, etc. and return how many were written.
+   At most <code>max</code> matches are written, when not given, all of them are.
+
+   This is the same as collecting the results of <code>Query.match</code>, except that it is done in one call and that
+   any tables that are already in <code>out</code> are reused for the matches (along with their <code>captures</code> tables)
+   rather than creating new ones. Entries of <code>out</code> after the returned count are left as they were so their tables can be reused later.
+
+   <pre>
+   local matches = {}
+   for _, node in ipairs(nodes) do
+      local n = query:matches_into(node, matches)
+      for i = 1, n do
+         print(matches[i].captures.name)
+      end
+   end
+   </pre>
+]]*/
+static int query_matches_into(lua_State *L) {
+	ltreesitter_Query *const lq = query_assert(L, 1);
+	TSNode const n = *node_assert(L, 2);
+	luaL_checktype(L, 3, LUA_TTABLE);
+	uint32_t limit = UINT32_MAX;
+	if (!lua_isnoneornil(L, 4)) {
+		lua_Integer const max = luaL_checkinteger(L, 4);
+		luaL_argcheck(L, max >= 0, 4, "expected a non-negative integer");
+		if ((uint64_t)max < UINT32_MAX)
+			limit = (uint32_t)max;
+	}
+	lua_settop(L, 7); // query, node, out, max, predicates, start, end
+
+	TSQueryCursor *const c = push_query_cursor_with_range(L, 6); // query, node, out, max, predicates, start, end, cursor
+	node_push_tree(L, 2);                                         // ..., cursor, tree
+	int const tree_idx = lua_gettop(L);
+
+	uint32_t count = 0;
+	TSQueryMatch m;
+	ts_query_cursor_exec(c, lq->query, n);
+	while (count < limit && ts_query_cursor_next_match(c, &m)) {
+		if (!do_predicates(L, 1, lq, tree_idx, &m, 5))
+			continue;
+		++count;
+		lua_rawgeti(L, 3, count); // ..., ?match
+		if (lua_type(L, -1) != LUA_TTABLE) {
+			lua_pop(L, 1);
+			lua_createtable(L, 0, 5); // ..., match
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, 3, count);
+		}
+		fill_match(L, m, lq->query, tree_idx);
+		lua_pop(L, 1);
+	}
+
+	query_cursor_release_early(L, 8);
+	pushinteger(L, count);
+	return 1;
+}
+
+// A match recorded by a Query:run_many worker
+typedef struct {
+	uint32_t id;
+	uint16_t pattern_index;
+	uint16_t capture_count;
+	uint32_t capture_start; // index into TreeRun.captures
+	// whether the pattern has predicates that have to be run on the Lua thread
+	bool needs_lua_predicates;
+} RawMatch;
+
+// The results of running a query against one tree in Query:run_many
+typedef struct {
+	// each tree is copied for its worker so that no two threads use the same
+	// TSTree, the recorded nodes belong to the original tree though
+	TSTree *copy;
+	TSTree const *original;
+	char const *text; // NULL when the tree was parsed with a reader function
+	TSInputEncoding encoding;
+
+	RawMatch *matches;
+	uint32_t match_count, match_capacity;
+	TSQueryCapture *captures;
+	uint32_t capture_count, capture_capacity;
+	bool alloc_failed;
+} TreeRun;
+
+typedef struct {
+	ltreesitter_Query const *lq;
+	// for each pattern, whether all of its predicates are evaluated natively
+	// (and so can be evaluated by a worker)
+	bool *pattern_is_native;
+	TreeRun *trees;
+	uint32_t tree_count;
+	uint32_t volatile next; // index of the next tree to be claimed by a worker
+} QueryRun;
+
+static bool record_match(TreeRun *tr, TSQueryMatch const *m, bool needs_lua_predicates) {
+	if (tr->match_count >= tr->match_capacity) {
+		uint32_t const new_capacity = tr->match_capacity ? tr->match_capacity * 2 : 16;
+		RawMatch *const new_matches = realloc(tr->matches, sizeof(RawMatch) * new_capacity);
+		if (!new_matches)
+			return false;
+		tr->matches = new_matches;
+		tr->match_capacity = new_capacity;
+	}
+	if (tr->capture_count + m->capture_count > tr->capture_capacity) {
+		uint32_t new_capacity = tr->capture_capacity ? tr->capture_capacity * 2 : 32;
+		while (new_capacity < tr->capture_count + m->capture_count)
+			new_capacity *= 2;
+		TSQueryCapture *const new_captures = realloc(tr->captures, sizeof(TSQueryCapture) * new_capacity);
+		if (!new_captures)
+			return false;
+		tr->captures = new_captures;
+		tr->capture_capacity = new_capacity;
+	}
+
+	for (uint16_t i = 0; i < m->capture_count; ++i) {
+		TSQueryCapture capture = m->captures[i];
+		capture.node.tree = tr->original;
+		tr->captures[tr->capture_count + i] = capture;
+	}
+	tr->matches[tr->match_count++] = (RawMatch){
+		.id = m->id,
+		.pattern_index = m->pattern_index,
+		.capture_count = m->capture_count,
+		.capture_start = tr->capture_count,
+		.needs_lua_predicates = needs_lua_predicates,
+	};
+	tr->capture_count += m->capture_count;
+	return true;
+}
+
+static void query_run_worker(void *arg) {
+	QueryRun *const run = arg;
+	ltreesitter_Query const *const lq = run->lq;
+	TSQueryCursor *const cursor = ts_query_cursor_new();
+
+	for (;;) {
+		uint32_t const i = atomic_fetch_add_u32(&run->next, 1);
+		if (i >= run->tree_count)
+			break;
+		TreeRun *const tr = &run->trees[i];
+		PredicateSource const src = {.text = tr->text, .encoding = tr->encoding};
+
+		TSQueryMatch m;
+		ts_query_cursor_exec(cursor, lq->query, ts_tree_root_node(tr->copy));
+		while (ts_query_cursor_next_match(cursor, &m)) {
+			PatternPredicates const pattern = lq->patterns[m.pattern_index];
+			bool needs_lua_predicates = false;
+			if (pattern.predicate_count > 0) {
+				if (tr->text && run->pattern_is_native[m.pattern_index]) {
+					bool passed = true;
+					for (uint32_t j = 0; passed && j < pattern.predicate_count; ++j)
+						passed = eval_native_predicate(&src, lq, &m, &lq->predicates[pattern.predicate_start + j]);
+					if (!passed)
+						continue;
+				} else {
+					needs_lua_predicates = true;
+				}
+			}
+			if (!record_match(tr, &m, needs_lua_predicates)) {
+				tr->alloc_failed = true;
+				break;
+			}
+		}
+	}
+
+	ts_query_cursor_delete(cursor);
+}
+
+static int query_run_gc(lua_State *L) {
+	QueryRun *const run = luaL_checkudata(L, 1, LTREESITTER_QUERY_RUN_METATABLE_NAME);
+	for (uint32_t i = 0; i < run->tree_count; ++i) {
+		if (run->trees[i].copy)
+			ts_tree_delete(run->trees[i].copy);
+		free(run->trees[i].matches);
+		free(run->trees[i].captures);
+	}
+	free(run->trees);
+	free(run->pattern_is_native);
+	run->trees = NULL;
+	run->pattern_is_native = NULL;
+	run->tree_count = 0;
+	return 0;
+}
+
+/* @teal-inline [[
+   interface QueryRunOptions
+      threads: integer
+      predicates: {string:Predicate}
+   end
+]] */
+
+/* @teal-export Query.run_many: function(Query, trees: {Tree}, opts?: QueryRunOptions): {{Match}} [[
+   Run a query against the root of each of the given trees, using up to <code>opts.threads</code> threads at once (defaults to the number of processors),
+   and return an array of the matches for each tree, in the same order as the trees.
+
+   Each thread uses its own query cursor and records the matches of a tree without creating any Lua objects.
+   Patterns without predicates, or whose predicates are all evaluated natively (see <code>Query.match</code>), are handled entirely by the threads.
+   Any other predicates, i.e. those from <code>opts.predicates</code>, are called afterwards on the calling thread, in order.
+
+   <pre>
+   local matches = query:run_many(trees, { threads = 8 })
+   for i, tree_matches in ipairs(matches) do
+      for _, match in ipairs(tree_matches) do
+         print(paths[i], match.captures.name)
+      end
+   end
+   </pre>
+
+   If ltreesitter was built with <code>LTREESITTER_NO_THREADS</code>, every tree is queried on the calling thread.
+]]*/
+static int query_run_many(lua_State *L) {
+	ltreesitter_Query *const lq = query_assert(L, 1);
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_settop(L, 3);
+	uint32_t thread_count = hardware_thread_count();
+	lua_pushnil(L); // query, trees, opts, predicates
+	if (!lua_isnil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lua_getfield(L, 3, "threads"); // query, trees, opts, predicates, ?threads
+		if (!lua_isnil(L, -1)) {
+			if (!lua_isnumber(L, -1) || lua_tointeger(L, -1) < 1)
+				return luaL_error(L, "Expected opts.threads to be a positive integer");
+			lua_Integer const n = lua_tointeger(L, -1);
+			thread_count = n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+		}
+		lua_pop(L, 1);
+		lua_getfield(L, 3, "predicates"); // query, trees, opts, predicates, ?predicates
+		lua_replace(L, 4);                // query, trees, opts, predicates
+	}
+	int const predicates_idx = 4;
+	uint32_t const tree_count = (uint32_t)length_of(L, 2);
+	uint32_t const pattern_count = ts_query_pattern_count(lq->query);
+
+	// keep our own array of the trees in case a predicate modifies the given one
+	lua_createtable(L, tree_count, 0); // ..., trees copy
+	int const trees_idx = lua_gettop(L);
+	for (uint32_t i = 0; i < tree_count; ++i) {
+		lua_rawgeti(L, 2, i + 1); // ..., trees copy, tree
+		if (!tree_check(L, -1))
+			return luaL_error(L, "Expected a Tree at index %d, got %s", (int)i + 1, luaL_typename(L, -1));
+		lua_rawseti(L, trees_idx, i + 1); // ..., trees copy
+	}
+
+	QueryRun *const run = lua_newuserdata(L, sizeof(QueryRun)); // ..., trees copy, run
+	memset(run, 0, sizeof *run);
+	setmetatable(L, LTREESITTER_QUERY_RUN_METATABLE_NAME);
+	int const run_idx = lua_gettop(L);
+	run->lq = lq;
+	run->pattern_is_native = malloc(sizeof(bool) * (pattern_count > 0 ? pattern_count : 1));
+	if (!run->pattern_is_native)
+		return ALLOC_FAIL(L);
+	run->trees = calloc(tree_count > 0 ? tree_count : 1, sizeof(TreeRun));
+	if (!run->trees)
+		return ALLOC_FAIL(L);
+	run->tree_count = tree_count;
+
+	push_resolved_predicates(L, lq, 1, predicates_idx); // ..., run, resolved
+	for (uint32_t i = 0; i < pattern_count; ++i) {
+		PatternPredicates const pattern = lq->patterns[i];
+		bool is_native = true;
+		for (uint32_t j = 0; is_native && j < pattern.predicate_count; ++j) {
+			lua_rawgeti(L, -1, pattern.predicate_start + j + 1); // ..., run, resolved, function|boolean
+			is_native = lua_type(L, -1) == LUA_TBOOLEAN && lua_toboolean(L, -1);
+			lua_pop(L, 1);
+		}
+		run->pattern_is_native[i] = is_native;
+	}
+	lua_pop(L, 1); // ..., run
+
+	for (uint32_t i = 0; i < tree_count; ++i) {
+		lua_rawgeti(L, trees_idx, i + 1); // ..., run, tree
+		ltreesitter_Tree const *const t = tree_assert(L, -1);
+		lua_pop(L, 1);
+		run->trees[i].original = t->tree;
+		run->trees[i].copy = ts_tree_copy(t->tree);
+		run->trees[i].text = t->text_or_null_if_function_reader;
+		run->trees[i].encoding = t->encoding;
+	}
+
+	run_on_threads(query_run_worker, run, thread_count < tree_count ? thread_count : tree_count);
+
+	for (uint32_t i = 0; i < tree_count; ++i) {
+		ts_tree_delete(run->trees[i].copy);
+		run->trees[i].copy = NULL;
+		if (run->trees[i].alloc_failed)
+			return ALLOC_FAIL(L);
+	}
+
+	lua_createtable(L, tree_count, 0); // ..., run, results
+	for (uint32_t i = 0; i < tree_count; ++i) {
+		TreeRun const *const tr = &run->trees[i];
+		lua_rawgeti(L, trees_idx, i + 1); // ..., run, results, tree
+		int const tree_idx = lua_gettop(L);
+		lua_createtable(L, tr->match_count, 0); // ..., run, results, tree, matches
+		uint32_t count = 0;
+		for (uint32_t j = 0; j < tr->match_count; ++j) {
+			RawMatch const *const raw = &tr->matches[j];
+			TSQueryMatch const m = {
+				.id = raw->id,
+				.pattern_index = raw->pattern_index,
+				.capture_count = raw->capture_count,
+				.captures = &tr->captures[raw->capture_start],
+			};
+			if (raw->needs_lua_predicates && !do_predicates(L, 1, lq, tree_idx, &m, predicates_idx))
+				continue;
+			push_match(L, m, lq->query, tree_idx); // ..., run, results, tree, matches, match
+			lua_rawseti(L, -2, ++count);           // ..., run, results, tree, matches
+		}
+		lua_rawseti(L, -3, i + 1); // ..., run, results, tree
+		lua_pop(L, 1);             // ..., run, results
+	}
+
+	// free the buffers now rather than whenever the run is collected
+	lua_pushcfunction(L, query_run_gc); // ..., run, results, gc
+	lua_pushvalue(L, run_idx);          // ..., run, results, gc, run
+	lua_call(L, 1, 0);                  // ..., run, results
+	return 1;
+}
+
 static bool predicate_arg_to_string(
 	lua_State *L,
 	int index,
@@ -570,37 +1325,65 @@ static bool ensure_predicate_arg_string(
 }
 
 // Predicates
-static int eq_predicate(lua_State *L) {
-	int const num_args = lua_gettop(L);
+// These are only called when a predicate can't be evaluated natively (see
+// eval_native_predicate), e.g. when a pattern is given through a capture
+
+static bool args_are_equal(lua_State *L, char const *name, int num_args) {
 	if (num_args < 2) {
-		luaL_error(L, "predicate eq? expects 2 or more arguments, got %d", num_args);
+		luaL_error(L, "predicate %s expects 2 or more arguments, got %d", name, num_args);
 	}
-	MaybeOwnedString a;
-	if (!predicate_arg_to_string(L, 1, &a)) {
-		lua_pushboolean(L, false);
-		mos_free(&a);
-		return 1;
-	}
-	MaybeOwnedString b;
+	MaybeOwnedString a = {0};
+	if (!predicate_arg_to_string(L, 1, &a))
+		return false;
+	MaybeOwnedString b = {0};
 	for (int i = 2; i <= num_args; ++i) {
 		if (!predicate_arg_to_string(L, i, &b)) {
-			lua_pushboolean(L, false);
 			mos_free(&a);
 			mos_free(&b);
-			return 1;
+			return false;
 		}
 		if (!mos_eq(a, b)) {
-			lua_pushboolean(L, false);
 			mos_free(&a);
 			mos_free(&b);
-			return 1;
+			return false;
 		};
 		mos_free(&a);
 		a = b;
 	}
 	mos_free(&a);
+	return true;
+}
 
-	lua_pushboolean(L, true);
+static int eq_predicate(lua_State *L) {
+	lua_pushboolean(L, args_are_equal(L, "eq?", lua_gettop(L)));
+	return 1;
+}
+
+static int not_eq_predicate(lua_State *L) {
+	lua_pushboolean(L, !args_are_equal(L, "not-eq?", lua_gettop(L)));
+	return 1;
+}
+
+static int any_of_predicate(lua_State *L) {
+	int const num_args = lua_gettop(L);
+	if (num_args < 2) {
+		luaL_error(L, "predicate any-of? expects 2 or more arguments, got %d", num_args);
+	}
+	MaybeOwnedString a;
+	if (!predicate_arg_to_string(L, 1, &a)) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	bool found = false;
+	for (int i = 2; !found && i <= num_args; ++i) {
+		MaybeOwnedString b;
+		if (predicate_arg_to_string(L, i, &b)) {
+			found = mos_eq(a, b);
+			mos_free(&b);
+		}
+	}
+	mos_free(&a);
+	lua_pushboolean(L, found);
 	return 1;
 }
 
@@ -612,10 +1395,10 @@ static inline void open_stringlib(lua_State *L) {
 #endif
 }
 
-static int match_predicate(lua_State *L) {
+static void push_string_match(lua_State *L, char const *name) {
 	int const num_args = lua_gettop(L);
 	if (num_args != 2) {
-		luaL_error(L, "predicate match? expects exactly 2 arguments, got %d", num_args);
+		luaL_error(L, "predicate %s expects exactly 2 arguments, got %d", name, num_args);
 	}
 
 	open_stringlib(L);            // string|Node, pattern, string lib
@@ -626,12 +1409,26 @@ static int match_predicate(lua_State *L) {
 	lua_insert(L, -2); // string.match, pattern, string|Node
 	if (!ensure_predicate_arg_string(L, -1)) {
 		lua_pushboolean(L, false);
-		return 1;
+		return;
 	}
 	// string.match, pattern, string
 	lua_insert(L, -2); // string.match, string, pattern
 	lua_call(L, 2, 1);
+}
 
+static int match_predicate(lua_State *L) {
+	push_string_match(L, "match?");
+	return 1;
+}
+
+static int lua_match_predicate(lua_State *L) {
+	push_string_match(L, "lua-match?");
+	return 1;
+}
+
+static int not_match_predicate(lua_State *L) {
+	push_string_match(L, "not-match?");
+	lua_pushboolean(L, !lua_toboolean(L, -1));
 	return 1;
 }
 
@@ -664,14 +1461,11 @@ static int find_predicate(lua_State *L) {
 /* @teal-export Query.cursor: function(Query, Node): QueryCursor [[
 ]] */
 static int make_cursor(lua_State *L) {
-	TSQuery *const q = *query_assert(L, 1);
+	TSQuery *const q = query_assert(L, 1)->query;
 	TSNode n = *node_assert(L, 2);
-	TSQueryCursor *const c = ts_query_cursor_new();
+	TSQueryCursor *const c = query_cursor_push(L);
 	ts_query_cursor_exec(c, q, n);
 
-	*(TSQueryCursor **)lua_newuserdata(L, sizeof c) = c;
-	setmetatable(L, LTREESITTER_QUERY_CURSOR_METATABLE_NAME);
-
 	// kept object needs to be a table since we're keeping two things alive
 	lua_createtable(L, 2, 0);
 	lua_pushvalue(L, 1);
@@ -691,7 +1485,7 @@ static int make_cursor(lua_State *L) {
 ]] */
 /* @teal-export Query.predicates_for_pattern: function(Query, integer): {{string | Capture}} */
 static int predicates_for_pattern(lua_State *L) {
-	TSQuery const *const q = *query_assert(L, 1);
+	TSQuery const *const q = query_assert(L, 1)->query;
 	lua_Integer pattern_index = luaL_checkinteger(L, 2);
 	luaL_argcheck(L, pattern_index >= 0, 2, "expected a non-negative integer (a pattern index)");
 	luaL_argcheck(L, pattern_index < ts_query_pattern_count(q), 2, "pattern index out of range");
@@ -739,7 +1533,11 @@ static int predicates_for_pattern(lua_State *L) {
 
 static const luaL_Reg default_query_predicates[] = {
 	{"eq?", eq_predicate},
+	{"not-eq?", not_eq_predicate},
+	{"any-of?", any_of_predicate},
 	{"match?", match_predicate},
+	{"lua-match?", lua_match_predicate},
+	{"not-match?", not_match_predicate},
 	{"find?", find_predicate},
 	{NULL, NULL}};
 
@@ -754,8 +1552,12 @@ static const luaL_Reg query_methods[] = {
 	{"capture_count", query_capture_count},
 	{"string_count", query_string_count},
 	{"match", query_match_factory},
+	{"matches_into", query_matches_into},
 	{"capture", query_capture_factory},
+	{"capture_names", query_capture_names},
+	{"capture_ranges", query_capture_ranges_factory},
 	{"exec", query_exec},
+	{"run_many", query_run_many},
 	{"cursor", make_cursor},
 	{"predicates_for_pattern", predicates_for_pattern},
 	{NULL, NULL}};
@@ -765,5 +1567,10 @@ static const luaL_Reg query_metamethods[] = {
 	{NULL, NULL}};
 
 void query_init_metatable(lua_State *L) {
+	static const luaL_Reg query_run_metamethods[] = {
+		{"__gc", query_run_gc},
+		{NULL, NULL}};
+	create_metatable(L, LTREESITTER_QUERY_RUN_METATABLE_NAME, query_run_metamethods, NULL);
+	lua_pop(L, 1);
 	create_metatable(L, LTREESITTER_QUERY_METATABLE_NAME, query_metamethods, query_methods);
 }
@@ -1,16 +1,69 @@
 #ifndef LTREESITTER_QUERY_H
 #define LTREESITTER_QUERY_H
 
+#include "pattern.h"
 #include "types.h"
 #include <lua.h>
 #include <tree_sitter/api.h>
 
+// Predicates are compiled once when a query is created rather than
+// re-walking ts_query_predicates_for_pattern for every match
+
+typedef enum {
+	PREDICATE_ARG_STRING,
+	PREDICATE_ARG_CAPTURE,
+} PredicateArgType;
+
+typedef struct {
+	PredicateArgType type;
+	uint32_t value_id; // a string id or a capture id depending on `type`
+} PredicateArg;
+
+// Built in predicates that can be evaluated directly against the source of
+// a tree without calling into Lua
+typedef enum {
+	NATIVE_PREDICATE_NONE,
+	NATIVE_PREDICATE_EQ,        // eq?
+	NATIVE_PREDICATE_NOT_EQ,    // not-eq?
+	NATIVE_PREDICATE_ANY_OF,    // any-of?
+	NATIVE_PREDICATE_MATCH,     // match? and lua-match?
+	NATIVE_PREDICATE_NOT_MATCH, // not-match?
+	NATIVE_PREDICATE_FIND,      // find?
+} NativePredicate;
+
+typedef struct {
+	uint32_t name_id; // string id of the predicate's name
+	bool is_question;
+	// NATIVE_PREDICATE_NONE when the arguments aren't something the native
+	// version can handle, in which case the Lua version is used
+	NativePredicate native;
+	Pattern pattern; // for NATIVE_PREDICATE_MATCH and NATIVE_PREDICATE_NOT_MATCH
+	// slice of ltreesitter_Query.predicate_args
+	uint32_t arg_start, arg_count;
+} CompiledPredicate;
+
+typedef struct {
+	// slice of ltreesitter_Query.predicates
+	// question predicates are ordered before non-question predicates
+	uint32_t predicate_start, predicate_count;
+} PatternPredicates;
+
+typedef struct {
+	TSQuery *query;
+	PatternPredicates *patterns;
+	CompiledPredicate *predicates;
+	PredicateArg *predicate_args;
+	uint32_t predicate_count;
+	uint32_t max_predicate_args;
+} ltreesitter_Query;
+
 // ( -- table )
 void query_init_metatable(lua_State *L);
 
-def_check_assert(TSQuery *, query, LTREESITTER_QUERY_METATABLE_NAME)
+def_check_assert(ltreesitter_Query, query, LTREESITTER_QUERY_METATABLE_NAME)
 
 // ( -- query )
+// takes ownership of the given TSQuery
 void query_push(lua_State *L, TSQuery *, int language_index);
 
 void query_setup_predicate_tables(lua_State *L);
@@ -5,9 +5,91 @@
 #include "query_cursor.h"
 #include "types.h"
 
+static char const *pool_registry_field = "query_cursor_pool";
+
+#define QUERY_CURSOR_POOL_CAPACITY 16
+
+typedef struct {
+	// set once the pool has been collected (i.e. the lua_State is being
+	// closed) so that any QueryCursors collected after it don't try to use it
+	bool closed;
+	uint32_t count;
+	TSQueryCursor *cursors[QUERY_CURSOR_POOL_CAPACITY];
+} QueryCursorPool;
+
+static int query_cursor_pool_gc(lua_State *L) {
+	QueryCursorPool *const pool = luaL_checkudata(L, 1, LTREESITTER_QUERY_CURSOR_POOL_METATABLE_NAME);
+	for (uint32_t i = 0; i < pool->count; ++i)
+		ts_query_cursor_delete(pool->cursors[i]);
+	pool->count = 0;
+	pool->closed = true;
+	return 0;
+}
+
+void query_cursor_setup_pool(lua_State *L) {
+	static const luaL_Reg metamethods[] = {
+		{"__gc", query_cursor_pool_gc},
+		{NULL, NULL}};
+	create_metatable(L, LTREESITTER_QUERY_CURSOR_POOL_METATABLE_NAME, metamethods, NULL);
+	lua_pop(L, 1);
+
+	QueryCursorPool *const pool = lua_newuserdata(L, sizeof(QueryCursorPool)); // pool
+	*pool = (QueryCursorPool){0};
+	setmetatable(L, LTREESITTER_QUERY_CURSOR_POOL_METATABLE_NAME);
+	set_registry_field(L, pool_registry_field);
+	lua_pop(L, 1);
+}
+
+static QueryCursorPool *get_pool(lua_State *L) {
+	push_registry_field(L, pool_registry_field);
+	QueryCursorPool *const pool = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return pool && !pool->closed ? pool : NULL;
+}
+
+// Get a cursor from the pool, or a new one if the pool is empty
+static TSQueryCursor *acquire(lua_State *L) {
+	QueryCursorPool *const pool = get_pool(L);
+	if (!pool || pool->count == 0)
+		return ts_query_cursor_new();
+
+	TSQueryCursor *const c = pool->cursors[--pool->count];
+	ts_query_cursor_set_byte_range(c, 0, UINT32_MAX);
+	ts_query_cursor_set_point_range(c, (TSPoint){0, 0}, (TSPoint){UINT32_MAX, UINT32_MAX});
+	ts_query_cursor_set_match_limit(c, UINT32_MAX);
+	ts_query_cursor_set_max_start_depth(c, UINT32_MAX);
+	return c;
+}
+
+// Give a cursor back to the pool, or delete it if the pool is full
+static void release(lua_State *L, TSQueryCursor *c) {
+	QueryCursorPool *const pool = get_pool(L);
+	if (!pool || pool->count >= QUERY_CURSOR_POOL_CAPACITY) {
+		ts_query_cursor_delete(c);
+		return;
+	}
+	pool->cursors[pool->count++] = c;
+}
+
+TSQueryCursor *query_cursor_push(lua_State *L) {
+	// the userdata is created first so that the cursor can't leak if that fails
+	TSQueryCursor **const lc = lua_newuserdata(L, sizeof(TSQueryCursor *));
+	*lc = NULL;
+	setmetatable(L, LTREESITTER_QUERY_CURSOR_METATABLE_NAME);
+	*lc = acquire(L);
+	return *lc;
+}
+
+void query_cursor_release_early(lua_State *L, int idx) {
+	TSQueryCursor **const c = query_cursor_assert(L, idx);
+	if (!*c)
+		return;
+	release(L, *c);
+	*c = NULL;
+}
+
 static int query_cursor_gc(lua_State *L) {
-	TSQueryCursor *c = *query_cursor_assert(L, 1);
-	ts_query_cursor_delete(c);
+	query_cursor_release_early(L, 1);
 	return 0;
 }
 
@@ -71,7 +153,7 @@ static int next_match_without_executing_predicates(lua_State *L) {
 	}
 	push_kept(L, 1); // cursor, {query, node}
 	lua_rawgeti(L, -1, 1); // cursor, {query, node}, query
-	TSQuery const *q = *query_assert(L, -1);
+	TSQuery const *q = query_assert(L, -1)->query;
 
 	lua_rawgeti(L, -2, 2); // cursor, {query, node}, query, node
 	push_kept(L, -1); // cursor, {query, node}, query, node, tree
@@ -94,7 +176,7 @@ static int next_capture_without_executing_predicates(lua_State *L) {
 	}
 	push_kept(L, 1); // cursor, {query, node}
 	lua_rawgeti(L, -1, 1); // cursor, {query, node}, query
-	TSQuery const *q = *query_assert(L, -1);
+	TSQuery const *q = query_assert(L, -1)->query;
 
 	lua_rawgeti(L, -2, 2); // cursor, {query, node}, query, node
 	push_kept(L, -1); // cursor, {query, node}, query, node, tree
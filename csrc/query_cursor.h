@@ -9,4 +9,23 @@ void query_cursor_init_metatable(lua_State *L);
 
 def_check_assert(TSQueryCursor *, query_cursor, LTREESITTER_QUERY_CURSOR_METATABLE_NAME)
 
+// TSQueryCursors keep around a fair amount of internal state that is
+// expensive to allocate, so rather than creating a new one for every
+// Query:match/capture/exec, a few are kept in a per lua_State pool
+
+// ( -- )
+void query_cursor_setup_pool(lua_State *L);
+
+// ( -- QueryCursor )
+// Get a cursor from the pool (or a new one if the pool is empty) with its
+// ranges, match limit, and max start depth reset to their defaults
+// The cursor is released back to the pool when the QueryCursor is collected
+TSQueryCursor *query_cursor_push(lua_State *L);
+
+// ( [idx]=QueryCursor | -- )
+// Release the cursor back to the pool once it won't be used again, rather
+// than waiting for the QueryCursor to be collected. The QueryCursor is left
+// without a cursor, so this is only for QueryCursors that aren't given to Lua
+void query_cursor_release_early(lua_State *L, int idx);
+
 #endif
@@ -0,0 +1,105 @@
+#include <lauxlib.h>
+#include <lua.h>
+
+#include <string.h>
+
+#include "luautils.h"
+#include "symbol_set.h"
+
+static inline void add_symbol(SymbolSet *set, TSSymbol symbol) {
+	uint32_t const slot = symbol_set_slot(symbol, set->symbol_count);
+	set->bits[slot / 8] |= (uint8_t)(1u << (slot % 8));
+}
+
+SymbolSet *symbol_set_push(lua_State *L, TSLanguage const *lang) {
+	uint32_t const symbol_count = ts_language_symbol_count(lang);
+	size_t const bitset_size = (symbol_count + 1 + 7) / 8;
+	SymbolSet *const set = lua_newuserdata(L, sizeof(SymbolSet) + bitset_size);
+	set->language = lang;
+	set->symbol_count = symbol_count;
+	memset(set->bits, 0, bitset_size);
+	setmetatable(L, LTREESITTER_SYMBOL_SET_METATABLE_NAME);
+	return set;
+}
+
+// ( [type_idx]=string|Symbol | -- )
+static void add_type(lua_State *L, SymbolSet *set, int type_idx) {
+	if (lua_type(L, type_idx) == LUA_TSTRING) {
+		size_t len;
+		char const *name = lua_tolstring(L, type_idx, &len);
+		bool found = false;
+		for (int is_named = 1; is_named >= 0; --is_named) {
+			TSSymbol const sym = ts_language_symbol_for_name(set->language, name, (uint32_t)len, is_named);
+			if (!sym)
+				continue;
+			found = true;
+			add_symbol(set, sym);
+		}
+		if (!found)
+			luaL_error(L, "Language has no node type '%s'", name);
+		return;
+	}
+	if (lua_type(L, type_idx) == LUA_TNUMBER) {
+		lua_Integer const sym = lua_tointeger(L, type_idx);
+		if (sym < 0 || (sym >= (lua_Integer)set->symbol_count && sym != (TSSymbol)-1))
+			luaL_error(L, "Language has no symbol %d", (int)sym);
+		add_symbol(set, (TSSymbol)sym);
+		return;
+	}
+	luaL_error(L, "Expected a node type name or Symbol, got %s", lua_typename(L, lua_type(L, type_idx)));
+}
+
+void symbol_set_add(lua_State *L, SymbolSet *set, int type_idx) {
+	if (lua_type(L, type_idx) != LUA_TTABLE) {
+		add_type(L, set, type_idx);
+		return;
+	}
+	type_idx = absindex(L, type_idx);
+	size_t const len = length_of(L, type_idx);
+	for (size_t i = 1; i <= len; ++i) {
+		lua_rawgeti(L, type_idx, (int)i); // type
+		add_type(L, set, -1);
+		lua_pop(L, 1);
+	}
+}
+
+static SymbolSet *check_language(lua_State *L, int idx, SymbolSet *set, TSLanguage const *lang) {
+	luaL_argcheck(L, set->language == lang, idx, "SymbolSet is for a different language");
+	return set;
+}
+
+SymbolSet *symbol_set_opt(lua_State *L, int idx, TSLanguage const *lang) {
+	if (lua_isnoneornil(L, idx))
+		return NULL;
+	return check_language(L, idx, symbol_set_assert(L, idx), lang);
+}
+
+SymbolSet *symbol_set_from_arg(lua_State *L, int idx, TSLanguage const *lang) {
+	idx = absindex(L, idx);
+	SymbolSet *set = symbol_set_check(L, idx);
+	if (set)
+		return check_language(L, idx, set, lang);
+	set = symbol_set_push(L, lang); // set
+	symbol_set_add(L, set, idx);
+	lua_replace(L, idx);
+	return set;
+}
+
+/* @teal-export SymbolSet.contains: function(SymbolSet, Symbol): boolean [[
+   Check whether the given symbol is in the set
+]] */
+static int symbol_set_contains_method(lua_State *L) {
+	SymbolSet const *const set = symbol_set_assert(L, 1);
+	lua_Integer const sym = luaL_checkinteger(L, 2);
+	lua_pushboolean(L, sym >= 0 && sym <= (TSSymbol)-1 && symbol_set_contains(set, (TSSymbol)sym));
+	return 1;
+}
+
+static const luaL_Reg symbol_set_methods[] = {
+	{"contains", symbol_set_contains_method},
+	{NULL, NULL}};
+
+void symbol_set_init_metatable(lua_State *L) {
+	create_metatable(L, LTREESITTER_SYMBOL_SET_METATABLE_NAME, (luaL_Reg[]){{NULL, NULL}}, symbol_set_methods);
+	lua_pop(L, 1);
+}
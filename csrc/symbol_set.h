@@ -0,0 +1,55 @@
+#ifndef LTREESITTER_SYMBOL_SET_H
+#define LTREESITTER_SYMBOL_SET_H
+
+#include "luautils.h"
+#include "types.h"
+#include <lua.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <tree_sitter/api.h>
+
+// A set of a language's symbols as a dense bitset, so checking the type of a
+// node is a single lookup rather than a string comparison
+//
+// ERROR's symbol ((TSSymbol)-1) gets the bit just past the language's symbols
+
+typedef struct {
+	TSLanguage const *language;
+	uint32_t symbol_count;
+	uint8_t bits[];
+} SymbolSet;
+
+def_check_assert(SymbolSet, symbol_set, LTREESITTER_SYMBOL_SET_METATABLE_NAME)
+
+// ( -- )
+void symbol_set_init_metatable(lua_State *L);
+
+// ( -- SymbolSet )
+// The set starts out empty and does not keep the language alive
+SymbolSet *symbol_set_push(lua_State *L, TSLanguage const *);
+
+// ( [type_idx]=string|Symbol|{string|Symbol} | -- )
+// Add the given node type names or symbols to the set, erroring on any the
+// language doesn't have. Names match both named and anonymous node types
+void symbol_set_add(lua_State *L, SymbolSet *, int type_idx);
+
+// ( [idx]=?SymbolSet | -- )
+// Get the set at idx, or NULL if it is nil, erroring if it isn't for `lang`
+SymbolSet *symbol_set_opt(lua_State *L, int idx, TSLanguage const *lang);
+
+// ( [idx]=SymbolSet|string|Symbol|{string|Symbol} | -- )
+// Get the set at idx, erroring if it isn't for `lang`. Otherwise build a set
+// for `lang` out of the types at idx, which is replaced with it
+SymbolSet *symbol_set_from_arg(lua_State *L, int idx, TSLanguage const *lang);
+
+// Index of a symbol in a set, or any other per symbol array of symbol_count + 1 entries
+static inline uint32_t symbol_set_slot(TSSymbol symbol, uint32_t symbol_count) {
+	return symbol == (TSSymbol)-1 ? symbol_count : symbol;
+}
+
+static inline bool symbol_set_contains(SymbolSet const *set, TSSymbol symbol) {
+	uint32_t const slot = symbol_set_slot(symbol, set->symbol_count);
+	return slot <= set->symbol_count && (set->bits[slot / 8] & (1u << (slot % 8)));
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "threads.h"
+
+#ifndef LTREESITTER_NO_THREADS
+
+#include <stdlib.h>
+
+typedef struct {
+	ThreadFunction f;
+	void *arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_trampoline(LPVOID p) {
+	ThreadStart start = *(ThreadStart *)p;
+	free(p);
+	start.f(start.arg);
+	return 0;
+}
+
+bool thread_create(Thread *t, ThreadFunction f, void *arg) {
+	ThreadStart *start = malloc(sizeof *start);
+	if (!start)
+		return false;
+	*start = (ThreadStart){f, arg};
+	*t = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+	if (!*t) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void thread_join(Thread t) {
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+
+bool mutex_init(Mutex *m) {
+	InitializeCriticalSection(m);
+	return true;
+}
+void mutex_destroy(Mutex *m) { DeleteCriticalSection(m); }
+void mutex_lock(Mutex *m) { EnterCriticalSection(m); }
+void mutex_unlock(Mutex *m) { LeaveCriticalSection(m); }
+
+bool condition_init(Condition *c) {
+	InitializeConditionVariable(c);
+	return true;
+}
+void condition_destroy(Condition *c) { (void)c; }
+void condition_wait(Condition *c, Mutex *m) { SleepConditionVariableCS(c, m, INFINITE); }
+void condition_signal(Condition *c) { WakeConditionVariable(c); }
+void condition_broadcast(Condition *c) { WakeAllConditionVariable(c); }
+
+uint32_t hardware_thread_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint32_t)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+#include <unistd.h>
+
+static void *thread_trampoline(void *p) {
+	ThreadStart start = *(ThreadStart *)p;
+	free(p);
+	start.f(start.arg);
+	return NULL;
+}
+
+bool thread_create(Thread *t, ThreadFunction f, void *arg) {
+	ThreadStart *start = malloc(sizeof *start);
+	if (!start)
+		return false;
+	*start = (ThreadStart){f, arg};
+	if (pthread_create(t, NULL, thread_trampoline, start) != 0) {
+		free(start);
+		return false;
+	}
+	return true;
+}
+
+void thread_join(Thread t) { pthread_join(t, NULL); }
+
+bool mutex_init(Mutex *m) { return pthread_mutex_init(m, NULL) == 0; }
+void mutex_destroy(Mutex *m) { pthread_mutex_destroy(m); }
+void mutex_lock(Mutex *m) { pthread_mutex_lock(m); }
+void mutex_unlock(Mutex *m) { pthread_mutex_unlock(m); }
+
+bool condition_init(Condition *c) { return pthread_cond_init(c, NULL) == 0; }
+void condition_destroy(Condition *c) { pthread_cond_destroy(c); }
+void condition_wait(Condition *c, Mutex *m) { pthread_cond_wait(c, m); }
+void condition_signal(Condition *c) { pthread_cond_signal(c); }
+void condition_broadcast(Condition *c) { pthread_cond_broadcast(c); }
+
+uint32_t hardware_thread_count(void) {
+	long const n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (uint32_t)n : 1;
+}
+
+#endif
+
+void run_on_threads(ThreadFunction f, void *arg, uint32_t thread_count) {
+	Thread *threads = NULL;
+	uint32_t spawned = 0;
+	if (thread_count > 1) {
+		threads = malloc(sizeof(Thread) * (thread_count - 1));
+		if (threads)
+			while (spawned < thread_count - 1 && thread_create(&threads[spawned], f, arg))
+				spawned += 1;
+	}
+
+	f(arg);
+
+	for (uint32_t i = 0; i < spawned; ++i)
+		thread_join(threads[i]);
+	free(threads);
+}
+
+#else
+
+uint32_t hardware_thread_count(void) {
+	return 1;
+}
+
+void run_on_threads(ThreadFunction f, void *arg, uint32_t thread_count) {
+	(void)thread_count;
+	f(arg);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef LTREESITTER_THREADS_H
+#define LTREESITTER_THREADS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A minimal wrapper around the native threading primitives (pthreads or
+// Win32) for the parts of ltreesitter that do work off of the Lua thread
+//
+// Define LTREESITTER_NO_THREADS to build without any threading support, in
+// which case that work is done synchronously on the calling thread instead
+
+typedef void (*ThreadFunction)(void *);
+
+#ifndef LTREESITTER_NO_THREADS
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#else
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#endif
+
+bool thread_create(Thread *, ThreadFunction, void *arg);
+void thread_join(Thread);
+
+bool mutex_init(Mutex *);
+void mutex_destroy(Mutex *);
+void mutex_lock(Mutex *);
+void mutex_unlock(Mutex *);
+
+bool condition_init(Condition *);
+void condition_destroy(Condition *);
+void condition_wait(Condition *, Mutex *);
+void condition_signal(Condition *);
+void condition_broadcast(Condition *);
+
+#endif
+
+// Number of threads that can actually run in parallel, at least 1
+// Always 1 without threading support
+uint32_t hardware_thread_count(void);
+
+// Calls `f(arg)` on `thread_count` threads at once, the calling thread
+// included, and returns once they have all returned. If fewer threads can be
+// created than asked for, `f` is just called on fewer threads
+void run_on_threads(ThreadFunction f, void *arg, uint32_t thread_count);
+
+// Atomics, usable without threads too since e.g. a signal handler may set a flag
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline uint32_t atomic_load_u32(uint32_t volatile *p) {
+	return (uint32_t)_InterlockedOr((long volatile *)p, 0);
+}
+static inline void atomic_store_u32(uint32_t volatile *p, uint32_t value) {
+	_InterlockedExchange((long volatile *)p, (long)value);
+}
+static inline uint32_t atomic_fetch_add_u32(uint32_t volatile *p, uint32_t value) {
+	return (uint32_t)_InterlockedExchangeAdd((long volatile *)p, (long)value);
+}
+#else
+static inline uint32_t atomic_load_u32(uint32_t volatile *p) {
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void atomic_store_u32(uint32_t volatile *p, uint32_t value) {
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+static inline uint32_t atomic_fetch_add_u32(uint32_t volatile *p, uint32_t value) {
+	return __atomic_fetch_add(p, value, __ATOMIC_ACQ_REL);
+}
+#endif
+
+#endif
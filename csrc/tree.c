@@ -10,7 +10,9 @@
 #include "luautils.h"
 #include "node.h"
 #include "object.h"
+#include "symbol_set.h"
 #include "tree.h"
+#include "tree_cursor.h"
 #include "types.h"
 
 #ifdef LOG_GC
@@ -20,36 +22,57 @@
 static ltreesitter_Tree *push_uninitialized_tree(lua_State *L) {
 	ltreesitter_Tree *tree = lua_newuserdata(L, sizeof *tree);
 	setmetatable(L, LTREESITTER_TREE_METATABLE_NAME);
+	tree->tree = NULL;
+	tree->handles = (NodeArena){0};
+	tree->reader_takes_integer_points = false;
 	return tree;
 }
 
-// src will be duplicated
 void tree_push(
 	lua_State *L,
 	TSTree *t,
-	size_t src_len,
-	char const *src) {
-	SourceText *source = source_text_push(L, src_len, src); // source text
-	ltreesitter_Tree *tree = push_uninitialized_tree(L);    // source text, tree
+	TSInputEncoding encoding,
+	int string_index) {
+	string_index = absindex(L, string_index);
+	size_t len;
+	char const *text = lua_tolstring(L, string_index, &len);
+	ltreesitter_Tree *tree = push_uninitialized_tree(L); // tree
+	tree->text_or_null_if_function_reader = text;
+	tree->text_length = (uint32_t)len;
+	tree->encoding = encoding;
+	bind_lifetimes(L, -1, string_index); // tree keeps string alive
 	tree->tree = t;
-	tree->text_or_null_if_function_reader = source;
-	bind_lifetimes(L, -1, -2); // tree keeps source text alive
-	lua_remove(L, -2);         // tree
+}
 
-	// fprintf(stderr, "Created tree %p with source %p\n", (void*)tree, (void*)tree->source);
+void tree_push_with_source_text(
+	lua_State *L,
+	TSTree *t,
+	TSInputEncoding encoding,
+	int source_text_index) {
+	source_text_index = absindex(L, source_text_index);
+	SourceText *const source = source_text_assert(L, source_text_index);
+	ltreesitter_Tree *tree = push_uninitialized_tree(L); // tree
+	tree->text_or_null_if_function_reader = source->text;
+	tree->text_length = source->length;
+	tree->encoding = encoding;
+	bind_lifetimes(L, -1, source_text_index); // tree keeps source text alive
+	tree->tree = t;
 }
 
 void tree_push_with_reader(
 	lua_State *L,
 	TSTree *t,
+	TSInputEncoding encoding,
 	int reader_function_index) {
 	lua_pushvalue(L, reader_function_index);             // reader
 	ltreesitter_Tree *tree = push_uninitialized_tree(L); // reader, tree
-	tree->tree = t;
 	tree->text_or_null_if_function_reader = NULL;
+	tree->text_length = 0;
+	tree->encoding = encoding;
 
 	bind_lifetimes(L, -1, -2); // tree keeps reader alive
 	lua_remove(L, -2);         // tree
+	tree->tree = t;
 }
 
 /* @teal-export Tree.root: function(Tree): Node [[
@@ -61,6 +84,352 @@ static int tree_push_root(lua_State *L) {
 	return 1;
 }
 
+/* @teal-inline [[
+   interface FlatTree
+      count: integer
+      symbol: {Symbol}
+      parent: {integer}
+      start_byte: {integer}
+      end_byte: {integer}
+      start_row: {integer}
+      start_column: {integer}
+      end_row: {integer}
+      end_column: {integer}
+      is_named: {boolean}
+      is_extra: {boolean}
+      is_missing: {boolean}
+   end
+
+   interface FlattenOptions
+      into: FlatTree
+      named_only: boolean
+   end
+]] */
+
+enum {
+	FLAT_SYMBOL,
+	FLAT_PARENT,
+	FLAT_START_BYTE,
+	FLAT_END_BYTE,
+	FLAT_START_ROW,
+	FLAT_START_COLUMN,
+	FLAT_END_ROW,
+	FLAT_END_COLUMN,
+	FLAT_IS_NAMED,
+	FLAT_IS_EXTRA,
+	FLAT_IS_MISSING,
+	FLAT_COLUMN_COUNT,
+};
+
+static char const *const flat_column_names[FLAT_COLUMN_COUNT] = {
+	[FLAT_SYMBOL] = "symbol",
+	[FLAT_PARENT] = "parent",
+	[FLAT_START_BYTE] = "start_byte",
+	[FLAT_END_BYTE] = "end_byte",
+	[FLAT_START_ROW] = "start_row",
+	[FLAT_START_COLUMN] = "start_column",
+	[FLAT_END_ROW] = "end_row",
+	[FLAT_END_COLUMN] = "end_column",
+	[FLAT_IS_NAMED] = "is_named",
+	[FLAT_IS_EXTRA] = "is_extra",
+	[FLAT_IS_MISSING] = "is_missing",
+};
+
+/* @teal-export Tree.flatten: function(Tree, FlattenOptions): FlatTree [[
+   Flatten the whole tree into parallel arrays in a single call
+
+   Nodes are visited in depth first pre-order, so <code>result.symbol[i]</code>,
+   <code>result.start_byte[i]</code>, etc. all describe the i'th node visited
+   (1-indexed), and <code>result.count</code> is the number of nodes.
+   <code>result.parent[i]</code> is the index of the i'th node's parent, or 0
+   for the root.
+
+   If <code>options.into</code> is provided, its arrays will be reused and
+   returned instead of allocating new ones. Entries past the new <code>count</code>
+   are cleared.
+
+   If <code>options.named_only</code> is true, only named nodes are included
+   and <code>parent</code> refers to the closest named ancestor.
+
+   <pre>
+   local flat = tree:flatten()
+   for i = 1, flat.count do
+      print(language:symbol_name(flat.symbol[i]), flat.start_byte[i], flat.end_byte[i])
+   end
+   </pre>
+]] */
+static int tree_flatten(lua_State *L) {
+	lua_settop(L, 2);
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	bool named_only = false;
+	if (lua_isnil(L, 2)) {
+		lua_pushnil(L); // tree, nil, nil
+	} else {
+		luaL_argcheck(L, lua_type(L, 2) == LUA_TTABLE, 2, "expected table");
+		lua_getfield(L, 2, "named_only");
+		named_only = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		lua_getfield(L, 2, "into"); // tree, options, ?into
+	}
+
+	TSNode const root = ts_tree_root_node(t->tree);
+	uint32_t const max_count = ts_node_descendant_count(root);
+	luaL_checkstack(L, FLAT_COLUMN_COUNT + 4, "Internal allocation failed");
+
+	uint32_t previous_count = 0;
+	if (lua_isnil(L, 3)) {
+		lua_pop(L, 1);
+		lua_createtable(L, 0, FLAT_COLUMN_COUNT + 1); // tree, options, result
+	} else {
+		luaL_argcheck(L, lua_type(L, 3) == LUA_TTABLE, 2, "expected `into' to be a table");
+		lua_getfield(L, 3, "count");
+		previous_count = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+	}
+	int const result_idx = 3;
+	int const first_column_idx = 4;
+
+	for (int i = 0; i < FLAT_COLUMN_COUNT; ++i) {
+		if (getfield_type(L, result_idx, flat_column_names[i]) != LUA_TTABLE) {
+			lua_pop(L, 1);
+			lua_createtable(L, max_count, 0);
+			lua_pushvalue(L, -1);
+			lua_setfield(L, result_idx, flat_column_names[i]);
+		}
+	} // tree, options, result, columns...
+
+	// parent_stack[depth] is the index that children of the node at `depth` should use as their parent
+	// Both it and the cursor are userdata so that they are collected if setting a column raises an error,
+	// and the tree can't be deeper than it has nodes
+	uint32_t *const parent_stack = lua_newuserdata(L, max_count * sizeof *parent_stack); // ..., columns..., parent stack
+	TSTreeCursor *const c = tree_cursor_push(L, 1, root);                                 // ..., columns..., parent stack, cursor
+	uint32_t depth = 0;
+	uint32_t count = 0;
+	for (;;) {
+		TSNode const n = ts_tree_cursor_current_node(c);
+		uint32_t const parent = depth > 0 ? parent_stack[depth - 1] : 0;
+		uint32_t self = parent;
+		bool const is_named = ts_node_is_named(n);
+
+		if (!named_only || is_named) {
+			self = ++count;
+			TSPoint const start = ts_node_start_point(n);
+			TSPoint const end = ts_node_end_point(n);
+
+#define SET_COLUMN(column, push_fn, value)                 \
+	do {                                                   \
+		push_fn(L, value);                                 \
+		lua_rawseti(L, first_column_idx + (column), self); \
+	} while (0)
+
+			SET_COLUMN(FLAT_SYMBOL, pushinteger, ts_node_symbol(n));
+			SET_COLUMN(FLAT_PARENT, pushinteger, parent);
+			SET_COLUMN(FLAT_START_BYTE, pushinteger, ts_node_start_byte(n));
+			SET_COLUMN(FLAT_END_BYTE, pushinteger, ts_node_end_byte(n));
+			SET_COLUMN(FLAT_START_ROW, pushinteger, start.row);
+			SET_COLUMN(FLAT_START_COLUMN, pushinteger, start.column);
+			SET_COLUMN(FLAT_END_ROW, pushinteger, end.row);
+			SET_COLUMN(FLAT_END_COLUMN, pushinteger, end.column);
+			SET_COLUMN(FLAT_IS_NAMED, lua_pushboolean, is_named);
+			SET_COLUMN(FLAT_IS_EXTRA, lua_pushboolean, ts_node_is_extra(n));
+			SET_COLUMN(FLAT_IS_MISSING, lua_pushboolean, ts_node_is_missing(n));
+
+#undef SET_COLUMN
+		}
+
+		parent_stack[depth] = self;
+
+		if (ts_tree_cursor_goto_first_child(c)) {
+			++depth;
+			continue;
+		}
+		while (!ts_tree_cursor_goto_next_sibling(c)) {
+			if (!ts_tree_cursor_goto_parent(c))
+				goto done;
+			--depth;
+		}
+	}
+done:
+
+	for (uint32_t i = count + 1; i <= previous_count; ++i) {
+		for (int col = 0; col < FLAT_COLUMN_COUNT; ++col) {
+			lua_pushnil(L);
+			lua_rawseti(L, first_column_idx + col, i);
+		}
+	}
+
+	lua_settop(L, result_idx);
+	pushinteger(L, count);
+	lua_setfield(L, result_idx, "count");
+	return 1;
+}
+
+/* @teal-inline [[
+   interface WalkHandler
+      enter: function(Node): boolean
+      leave: function(Node)
+   end
+]] */
+
+/* @teal-inline [[
+   interface WalkOptions
+      node: Node
+      named_only: boolean
+      skip: SymbolSet | string | Symbol | {string | Symbol}
+   end
+]] */
+
+#define WALK_ENTER 1
+#define WALK_LEAVE 2
+
+// ( [handler_idx]=function|WalkHandler, [enters_idx]=table, [leaves_idx]=table | -- )
+static void walk_add_handler(
+	lua_State *L,
+	uint8_t *dispatch,
+	uint32_t slot,
+	int handler_idx,
+	int enters_idx,
+	int leaves_idx) {
+	if (lua_type(L, handler_idx) == LUA_TFUNCTION) {
+		lua_pushvalue(L, handler_idx);
+		lua_rawseti(L, enters_idx, slot + 1);
+		dispatch[slot] |= WALK_ENTER;
+		return;
+	}
+	lua_getfield(L, handler_idx, "enter"); // ?enter
+	if (!lua_isnil(L, -1)) {
+		lua_rawseti(L, enters_idx, slot + 1);
+		dispatch[slot] |= WALK_ENTER;
+	} else {
+		lua_pop(L, 1);
+	}
+	lua_getfield(L, handler_idx, "leave"); // ?leave
+	if (!lua_isnil(L, -1)) {
+		lua_rawseti(L, leaves_idx, slot + 1);
+		dispatch[slot] |= WALK_LEAVE;
+	} else {
+		lua_pop(L, 1);
+	}
+}
+
+/* @teal-export Tree.walk: function(Tree, handlers: {string:(function(Node): boolean) | WalkHandler}, options?: WalkOptions) [[
+   Walk the tree depth first, calling the handlers for the types of the nodes visited
+
+   <code>handlers</code> maps node type names to either an <code>enter</code> function, or a table with
+   <code>enter</code> and/or <code>leave</code> functions. <code>enter</code> is called before a node's children are walked,
+   and the children are skipped if it returns <code>false</code>. <code>leave</code> is called after them,
+   unless <code>enter</code> returned <code>false</code>, so state pushed by <code>enter</code> can be popped by <code>leave</code>.
+
+   The walk is done in C with a single cursor and type names are resolved to symbols once up front,
+   so <code>Node</code>s are only created for the nodes that have a handler.
+
+   <code>options.node</code> walks only the given node (of this tree) and its descendants rather than the whole tree,
+   and when <code>options.named_only</code> is true type names only refer to named nodes.
+   Nodes with a type in <code>options.skip</code> are passed over along with their descendants, without calling any handlers.
+
+   <pre>
+   local calls = 0
+   tree:walk{
+      call_expression = function(node)
+         calls = calls + 1
+      end,
+      function_definition = {
+         enter = function(node) print("entering " .. node:child_by_field_name("declarator"):source()) end,
+         leave = function(node) print("leaving") end,
+      },
+   }
+   </pre>
+]] */
+static int tree_walk(lua_State *L) {
+	lua_settop(L, 3);
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	luaL_argcheck(L, lua_type(L, 2) == LUA_TTABLE, 2, "expected a table of handlers");
+
+	TSNode start = ts_tree_root_node(t->tree);
+	bool named_only = false;
+	lua_pushnil(L); // tree, handlers, options, nil
+	if (!lua_isnil(L, 3)) {
+		luaL_argcheck(L, lua_type(L, 3) == LUA_TTABLE, 3, "expected a table of walk options");
+		lua_getfield(L, 3, "node"); // tree, handlers, options, nil, ?node
+		if (!lua_isnil(L, -1)) {
+			start = *node_assert(L, -1);
+			luaL_argcheck(L, start.tree == t->tree, 3, "expected `node' to belong to the tree being walked");
+		}
+		lua_getfield(L, 3, "named_only"); // tree, handlers, options, nil, ?node, named_only
+		named_only = lua_toboolean(L, -1);
+		lua_getfield(L, 3, "skip"); // tree, handlers, options, nil, ?node, named_only, ?skip
+		lua_replace(L, 4);
+		lua_settop(L, 4);
+	} // tree, handlers, options, ?skip
+
+	TSLanguage const *const lang = ts_tree_language(t->tree);
+	uint32_t const symbol_count = ts_language_symbol_count(lang);
+	SymbolSet const *const skip = lua_isnil(L, 4) ? NULL : symbol_set_from_arg(L, 4, lang);
+
+	uint8_t *const dispatch = lua_newuserdata(L, symbol_count + 1); // tree, handlers, options, ?skip, dispatch
+	memset(dispatch, 0, symbol_count + 1);
+	lua_newtable(L); // tree, handlers, options, ?skip, dispatch, enters
+	lua_newtable(L); // tree, handlers, options, ?skip, dispatch, enters, leaves
+	int const enters_idx = 6;
+	int const leaves_idx = 7;
+
+	lua_pushnil(L);
+	while (lua_next(L, 2)) { // ..., name, handler
+		if (lua_type(L, -2) != LUA_TSTRING)
+			return luaL_error(L, "Expected handler keys to be node type names, got %s", lua_typename(L, lua_type(L, -2)));
+		int const handler_type = lua_type(L, -1);
+		size_t len;
+		char const *name = lua_tolstring(L, -2, &len);
+		if (handler_type != LUA_TFUNCTION && handler_type != LUA_TTABLE)
+			return luaL_error(L, "Expected the handler for '%s' to be a function or table, got %s", name, lua_typename(L, handler_type));
+
+		bool found = false;
+		for (int is_named = 1; is_named >= (named_only ? 1 : 0); --is_named) {
+			TSSymbol const sym = ts_language_symbol_for_name(lang, name, (uint32_t)len, is_named);
+			if (!sym)
+				continue;
+			found = true;
+			walk_add_handler(L, dispatch, symbol_set_slot(sym, symbol_count), -1, enters_idx, leaves_idx);
+		}
+		if (!found)
+			return luaL_error(L, "Language has no node type '%s'", name);
+		lua_pop(L, 1); // ..., name
+	} // tree, handlers, options, ?skip, dispatch, enters, leaves
+
+	TSTreeCursor *const c = tree_cursor_push(L, 1, start); // ..., cursor
+	for (;;) {
+		TSNode const n = ts_tree_cursor_current_node(c);
+		TSSymbol const sym = ts_node_symbol(n);
+		uint32_t const slot = symbol_set_slot(sym, symbol_count);
+		bool descend = !(skip && symbol_set_contains(skip, sym));
+		if (descend && (dispatch[slot] & WALK_ENTER)) {
+			lua_rawgeti(L, enters_idx, slot + 1); // ..., cursor, enter
+			node_push(L, 1, n);                   // ..., cursor, enter, node
+			lua_call(L, 1, 1);                    // ..., cursor, result
+			descend = !(lua_isboolean(L, -1) && !lua_toboolean(L, -1));
+			lua_pop(L, 1); // ..., cursor
+		}
+		if (descend && ts_tree_cursor_goto_first_child(c))
+			continue;
+
+		// the first node left is the one just entered, which gets no leave call when it was pruned,
+		// every other is an ancestor that was descended into
+		for (bool pruned = !descend;; pruned = false) {
+			TSNode const current = ts_tree_cursor_current_node(c);
+			uint32_t const current_slot = symbol_set_slot(ts_node_symbol(current), symbol_count);
+			if (!pruned && (dispatch[current_slot] & WALK_LEAVE)) {
+				lua_rawgeti(L, leaves_idx, current_slot + 1); // ..., cursor, leave
+				node_push(L, 1, current);                     // ..., cursor, leave, node
+				lua_call(L, 1, 0);                            // ..., cursor
+			}
+			if (ts_tree_cursor_goto_next_sibling(c))
+				break;
+			if (!ts_tree_cursor_goto_parent(c))
+				return 0;
+		}
+	}
+}
+
 static int tree_to_string(lua_State *L) {
 	TSTree *t = tree_assert(L, 1)->tree;
 	TSNode const root = ts_tree_root_node(t);
@@ -76,16 +445,14 @@ static int tree_to_string(lua_State *L) {
 static int tree_copy(lua_State *L) {
 	lua_settop(L, 1);
 	ltreesitter_Tree *t = tree_assert(L, 1); // tree
-	push_kept(L, 1);                         // tree, source text/reader
-	SourceText const *source_text = source_text_assert(L, -1);
-	if (!source_text) {
-		luaL_error(L, "Internal error: Tree child was not a SourceText");
-		return 0;
-	}
-	ltreesitter_Tree *const t_copy = push_uninitialized_tree(L); // tree, source text/reader, new tree
+	push_kept(L, 1);                         // tree, string/source text/reader
+	ltreesitter_Tree *const t_copy = push_uninitialized_tree(L); // tree, string/source text/reader, new tree
 	t_copy->tree = ts_tree_copy(t->tree);
-	t_copy->text_or_null_if_function_reader = source_text;
-	bind_lifetimes(L, -1, -2); // tree keeps source text/reader alive
+	t_copy->text_or_null_if_function_reader = t->text_or_null_if_function_reader;
+	t_copy->text_length = t->text_length;
+	t_copy->encoding = t->encoding;
+	t_copy->reader_takes_integer_points = t->reader_takes_integer_points;
+	bind_lifetimes(L, -1, -2); // new tree keeps string/source text/reader alive
 	return 1;
 }
 
@@ -198,8 +565,13 @@ static int tree_edit(lua_State *L) {
 static int tree_get_changed_ranges(lua_State *L) {
 	ltreesitter_Tree *old = tree_assert(L, 1);
 	ltreesitter_Tree *new = tree_assert(L, 2);
+	tree_push_changed_ranges(L, old->tree, new->tree);
+	return 1;
+}
+
+void tree_push_changed_ranges(lua_State *L, TSTree const *old_tree, TSTree const *new_tree) {
 	uint32_t len;
-	TSRange *ranges = ts_tree_get_changed_ranges(old->tree, new->tree, &len);
+	TSRange *ranges = ts_tree_get_changed_ranges(old_tree, new_tree, &len);
 
 	lua_createtable(L, len, 0); // { range }
 	for (uint32_t i = 0; i < len; i++) {
@@ -224,7 +596,258 @@ static int tree_get_changed_ranges(lua_State *L) {
 	}
 
 	free(ranges);
+}
+
+/* @teal-inline [[
+   type NodeHandle = integer
+]] */
+
+static inline uint32_t handle_hash(void const *id) {
+	uint64_t const x = (uint64_t)(uintptr_t)id >> 3;
+	return (uint32_t)(x ^ (x >> 32)) * 2654435761u;
+}
+
+// The slot of `arena->index` that holds the handle of the node with `id`, or the empty slot it would go in
+static uint32_t *handle_slot(NodeArena const *arena, void const *id) {
+	uint32_t const mask = arena->index_capacity - 1;
+	for (uint32_t i = handle_hash(id) & mask;; i = (i + 1) & mask) {
+		uint32_t *const slot = &arena->index[i];
+		if (*slot == 0 || arena->nodes[*slot - 1].id == id)
+			return slot;
+	}
+}
+
+// Keeps the index at most half full so probes stay short
+static void grow_handle_index(lua_State *L, NodeArena *arena) {
+	uint32_t const new_cap = arena->index_capacity ? arena->index_capacity * 2 : 128;
+	uint32_t *const new_index = calloc(new_cap, sizeof(uint32_t));
+	if (!new_index)
+		ALLOC_FAIL(L);
+	free(arena->index);
+	arena->index = new_index;
+	arena->index_capacity = new_cap;
+	for (uint32_t h = 0; h < arena->length; ++h)
+		*handle_slot(arena, arena->nodes[h].id) = h + 1;
+}
+
+// Handles are only valid until the next call to `Tree:release_handles`
+// A node gets the same handle each time it is pushed until then
+static uint32_t push_handle(lua_State *L, ltreesitter_Tree *t, TSNode n) {
+	NodeArena *const arena = &t->handles;
+	if ((arena->length + 1) * 2 > arena->index_capacity)
+		grow_handle_index(L, arena);
+	uint32_t *const slot = handle_slot(arena, n.id);
+	if (*slot != 0) {
+		pushinteger(L, *slot - 1);
+		return *slot - 1;
+	}
+	if (arena->length >= arena->capacity) {
+		uint32_t const new_cap = arena->capacity ? arena->capacity * 2 : 64;
+		TSNode *const new_nodes = realloc(arena->nodes, new_cap * sizeof(TSNode));
+		if (!new_nodes)
+			ALLOC_FAIL(L);
+		arena->nodes = new_nodes;
+		arena->capacity = new_cap;
+	}
+	arena->nodes[arena->length] = n;
+	*slot = arena->length + 1;
+	pushinteger(L, arena->length);
+	return arena->length++;
+}
+
+static void push_handle_or_nil(lua_State *L, ltreesitter_Tree *t, TSNode n) {
+	if (ts_node_is_null(n))
+		lua_pushnil(L);
+	else
+		push_handle(L, t, n);
+}
+
+static TSNode check_handle(lua_State *L, ltreesitter_Tree *t, int idx) {
+	lua_Integer const h = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, h >= 0 && h < t->handles.length, idx, "invalid node handle");
+	return t->handles.nodes[h];
+}
 
+/* @teal-export Tree.root_handle: function(Tree): NodeHandle [[
+   Get a handle to the root node of the given tree
+
+   Node handles are a lightweight alternative to <code>Node</code>s: they are
+   plain integers that index into an arena owned by the tree, so walking a
+   tree with them does not create a garbage collected object per node.
+   Handles are only meaningful to the tree that created them and stay valid
+   until <code>Tree:release_handles</code> is called.
+
+   Navigating to a node that already has a handle gives back that same handle, so the
+   arena only grows with the number of distinct nodes visited, and walking the tree again
+   doesn't use any more memory. Call <code>Tree:release_handles</code> once the handles
+   are no longer needed to empty it.
+
+   <pre>
+   local function walk(h)
+      print(tree:handle_type(h))
+      local child = tree:handle_child(h, 0)
+      while child do
+         walk(child)
+         child = tree:handle_next_sibling(child)
+      end
+   end
+   walk(tree:root_handle())
+   tree:release_handles()
+   </pre>
+]] */
+static int tree_root_handle(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	push_handle(L, t, ts_tree_root_node(t->tree));
+	return 1;
+}
+
+/* @teal-export Tree.release_handles: function(Tree) [[
+   Invalidate all node handles created by this tree, allowing their memory to be reused
+]] */
+static int tree_release_handles(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	t->handles.length = 0;
+	if (t->handles.index)
+		memset(t->handles.index, 0, t->handles.index_capacity * sizeof(uint32_t));
+	return 0;
+}
+
+/* @teal-export Tree.handle_node: function(Tree, NodeHandle): Node [[
+   Create a full <code>Node</code> from the given handle
+]] */
+static int tree_handle_node(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	node_push(L, 1, check_handle(L, t, 2));
+	return 1;
+}
+
+/* @teal-export Tree.handle_child: function(Tree, NodeHandle, idx: integer): NodeHandle [[
+   Get a handle to the idx'th child (0-indexed) of the given node handle
+]] */
+static int tree_handle_child(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	TSNode const n = check_handle(L, t, 2);
+	lua_Integer const idx = luaL_checkinteger(L, 3);
+	if (idx < 0 || idx >= ts_node_child_count(n))
+		lua_pushnil(L);
+	else
+		push_handle(L, t, ts_node_child(n, (uint32_t)idx));
+	return 1;
+}
+
+/* @teal-export Tree.handle_named_child: function(Tree, NodeHandle, idx: integer): NodeHandle [[
+   Get a handle to the idx'th named child (0-indexed) of the given node handle
+]] */
+static int tree_handle_named_child(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	TSNode const n = check_handle(L, t, 2);
+	lua_Integer const idx = luaL_checkinteger(L, 3);
+	if (idx < 0 || idx >= ts_node_named_child_count(n))
+		lua_pushnil(L);
+	else
+		push_handle(L, t, ts_node_named_child(n, (uint32_t)idx));
+	return 1;
+}
+
+#define HANDLE_NAVIGATION(fn_name, ts_fn)                       \
+	static int fn_name(lua_State *L) {                          \
+		ltreesitter_Tree *const t = tree_assert(L, 1);          \
+		push_handle_or_nil(L, t, ts_fn(check_handle(L, t, 2))); \
+		return 1;                                               \
+	}
+
+/* @teal-export Tree.handle_parent: function(Tree, NodeHandle): NodeHandle [[
+   Get a handle to the parent of the given node handle
+]] */
+HANDLE_NAVIGATION(tree_handle_parent, ts_node_parent)
+
+/* @teal-export Tree.handle_next_sibling: function(Tree, NodeHandle): NodeHandle [[
+   Get a handle to the next sibling of the given node handle
+]] */
+HANDLE_NAVIGATION(tree_handle_next_sibling, ts_node_next_sibling)
+
+/* @teal-export Tree.handle_prev_sibling: function(Tree, NodeHandle): NodeHandle [[
+   Get a handle to the previous sibling of the given node handle
+]] */
+HANDLE_NAVIGATION(tree_handle_prev_sibling, ts_node_prev_sibling)
+
+/* @teal-export Tree.handle_next_named_sibling: function(Tree, NodeHandle): NodeHandle [[
+   Get a handle to the next named sibling of the given node handle
+]] */
+HANDLE_NAVIGATION(tree_handle_next_named_sibling, ts_node_next_named_sibling)
+
+/* @teal-export Tree.handle_prev_named_sibling: function(Tree, NodeHandle): NodeHandle [[
+   Get a handle to the previous named sibling of the given node handle
+]] */
+HANDLE_NAVIGATION(tree_handle_prev_named_sibling, ts_node_prev_named_sibling)
+
+#undef HANDLE_NAVIGATION
+
+/* @teal-export Tree.handle_child_count: function(Tree, NodeHandle): integer [[
+   Get the number of children of the given node handle
+]] */
+static int tree_handle_child_count(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	pushinteger(L, ts_node_child_count(check_handle(L, t, 2)));
+	return 1;
+}
+
+/* @teal-export Tree.handle_named_child_count: function(Tree, NodeHandle): integer [[
+   Get the number of named children of the given node handle
+]] */
+static int tree_handle_named_child_count(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	pushinteger(L, ts_node_named_child_count(check_handle(L, t, 2)));
+	return 1;
+}
+
+/* @teal-export Tree.handle_type: function(Tree, NodeHandle): string [[
+   Get the type of the given node handle
+]] */
+static int tree_handle_type(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	lua_pushstring(L, ts_node_type(check_handle(L, t, 2)));
+	return 1;
+}
+
+/* @teal-export Tree.handle_symbol: function(Tree, NodeHandle): Symbol [[
+   Get the type of the given node handle as a numeric id
+]] */
+static int tree_handle_symbol(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	pushinteger(L, ts_node_symbol(check_handle(L, t, 2)));
+	return 1;
+}
+
+/* @teal-export Tree.handle_is_named: function(Tree, NodeHandle): boolean [[
+   Get whether or not the given node handle is named
+]] */
+static int tree_handle_is_named(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	lua_pushboolean(L, ts_node_is_named(check_handle(L, t, 2)));
+	return 1;
+}
+
+/* @teal-export Tree.handle_byte_range: function(Tree, NodeHandle): (integer, integer) [[
+   Get the start (inclusive) and end (exclusive) byte offsets of the given node handle
+]] */
+static int tree_handle_byte_range(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	TSNode const n = check_handle(L, t, 2);
+	pushinteger(L, ts_node_start_byte(n));
+	pushinteger(L, ts_node_end_byte(n));
+	return 2;
+}
+
+/* @teal-export Tree.handle_source: function(Tree, NodeHandle): string [[
+   Get the source code of the given node handle
+]] */
+static int tree_handle_source(lua_State *L) {
+	ltreesitter_Tree *const t = tree_assert(L, 1);
+	TSNode const n = check_handle(L, t, 2);
+	MaybeOwnedString str = node_get_source_in(L, 1, n);
+	mos_push_to_lua(L, str);
+	mos_free(&str);
 	return 1;
 }
 
@@ -235,6 +858,8 @@ static int tree_gc(lua_State *L) {
 	printf("    source text=%p\n", (void const *)t->text_or_null_if_function_reader);
 #endif
 	ts_tree_delete(t->tree);
+	free(t->handles.nodes);
+	free(t->handles.index);
 	return 0;
 }
 
@@ -244,6 +869,26 @@ static const luaL_Reg tree_methods[] = {
 	{"edit", tree_edit},
 	{"edit_s", tree_edit_s},
 	{"get_changed_ranges", tree_get_changed_ranges},
+	{"flatten", tree_flatten},
+	{"walk", tree_walk},
+
+	{"root_handle", tree_root_handle},
+	{"release_handles", tree_release_handles},
+	{"handle_node", tree_handle_node},
+	{"handle_child", tree_handle_child},
+	{"handle_named_child", tree_handle_named_child},
+	{"handle_parent", tree_handle_parent},
+	{"handle_next_sibling", tree_handle_next_sibling},
+	{"handle_prev_sibling", tree_handle_prev_sibling},
+	{"handle_next_named_sibling", tree_handle_next_named_sibling},
+	{"handle_prev_named_sibling", tree_handle_prev_named_sibling},
+	{"handle_child_count", tree_handle_child_count},
+	{"handle_named_child_count", tree_handle_named_child_count},
+	{"handle_type", tree_handle_type},
+	{"handle_symbol", tree_handle_symbol},
+	{"handle_is_named", tree_handle_is_named},
+	{"handle_byte_range", tree_handle_byte_range},
+	{"handle_source", tree_handle_source},
 	{NULL, NULL}};
 static const luaL_Reg tree_metamethods[] = {
 	{"__gc", tree_gc},
@@ -8,18 +8,34 @@ void tree_init_metatable(lua_State *L);
 
 def_check_assert(ltreesitter_Tree, tree, LTREESITTER_TREE_METATABLE_NAME)
 
-// ( -- tree )
-// this function copies `src`
+// The tree_push functions only take ownership of the TSTree once nothing else
+// can raise an error, so the caller still owns it if they raise
+
+// ( [string_index]=string | -- tree )
+// the tree uses the bytes of the given string directly and keeps it alive
 void tree_push(
 	lua_State *,
 	TSTree *,
-	size_t src_len,
-	char const *src);
+	TSInputEncoding,
+	int string_index);
+
+// ( [source_text_index]=SourceText | -- tree )
+// the tree uses the given source text directly
+void tree_push_with_source_text(
+	lua_State *,
+	TSTree *,
+	TSInputEncoding,
+	int source_text_index);
 
 // ( [reader_function_index]=function | -- tree )
 void tree_push_with_reader(
 	lua_State *,
 	TSTree *,
+	TSInputEncoding,
 	int reader_function_index);
 
+// ( -- {Range} )
+// Push the ranges that differ between the two trees, as Tree:get_changed_ranges does
+void tree_push_changed_ranges(lua_State *, TSTree const *old_tree, TSTree const *new_tree);
+
 #endif
@@ -1,4 +1,5 @@
 #include "tree_cursor.h"
+#include "language.h"
 #include "luautils.h"
 #include "node.h"
 #include "object.h"
@@ -58,21 +59,109 @@ static int tree_cursor_goto_parent(lua_State *L) {
 	return 1;
 }
 
-/* @teal-export Cursor.goto_next_sibling: function(Cursor): boolean [[
+/* @teal-inline [[
+   interface ChildFilter
+      types: SymbolSet | string | Symbol | {string | Symbol}
+      field: string | FieldId
+      named_only: boolean
+   end
+]] */
+ChildFilter child_filter_check(lua_State *L, int idx, TSLanguage const *lang) {
+	idx = absindex(L, idx);
+	ChildFilter filter = {0};
+	if (lua_isnoneornil(L, idx)) {
+		lua_pushnil(L);
+		return filter;
+	}
+	if (lua_type(L, idx) != LUA_TTABLE) {
+		filter.symbols = symbol_set_opt(L, idx, lang);
+		lua_pushvalue(L, idx);
+		return filter;
+	}
+
+	lua_getfield(L, idx, "field"); // ?field
+	if (!lua_isnil(L, -1))
+		filter.field = language_check_field(L, -1, lang);
+	lua_pop(L, 1);
+
+	lua_getfield(L, idx, "named_only"); // named_only
+	filter.named_only = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, idx, "types"); // ?types
+	if (!lua_isnil(L, -1))
+		filter.symbols = symbol_set_from_arg(L, -1, lang); // set
+	return filter;
+}
+
+static inline bool child_filter_matches(ChildFilter const *filter, TSTreeCursor const *c) {
+	if (filter->field && ts_tree_cursor_current_field_id(c) != filter->field)
+		return false;
+	if (!filter->symbols && !filter->named_only)
+		return true;
+	TSNode const n = ts_tree_cursor_current_node(c);
+	if (filter->named_only && !ts_node_is_named(n))
+		return false;
+	return !filter->symbols || symbol_set_contains(filter->symbols, ts_node_symbol(n));
+}
+
+bool tree_cursor_skip_to_match(TSTreeCursor *c, ChildFilter const *filter) {
+	do {
+		if (child_filter_matches(filter, c))
+			return true;
+	} while (ts_tree_cursor_goto_next_sibling(c));
+	return false;
+}
+
+// ( [idx]=?SymbolSet|ChildFilter | -- ?SymbolSet )
+static ChildFilter check_filter(lua_State *L, TSTreeCursor const *c, int idx) {
+	return child_filter_check(L, idx, ts_tree_language(ts_tree_cursor_current_node(c).tree));
+}
+
+/* @teal-export Cursor.goto_next_sibling: function(Cursor, filter?: SymbolSet | ChildFilter): boolean [[
    Position the cursor at the sibling of the current node
+
+   When a filter is given, the cursor is positioned at the next sibling that passes it
+   (see <code>Node.children</code>). If there is no such sibling the cursor is not moved
 ]] */
 static int tree_cursor_goto_next_sibling(lua_State *L) {
+	lua_settop(L, 2);
 	TSTreeCursor *const c = tree_cursor_assert(L, 1);
-	lua_pushboolean(L, ts_tree_cursor_goto_next_sibling(c));
+	if (lua_isnil(L, 2)) {
+		lua_pushboolean(L, ts_tree_cursor_goto_next_sibling(c));
+		return 1;
+	}
+	ChildFilter const filter = check_filter(L, c, 2);
+	uint32_t const start = ts_tree_cursor_current_descendant_index(c);
+	if (ts_tree_cursor_goto_next_sibling(c) && tree_cursor_skip_to_match(c, &filter)) {
+		lua_pushboolean(L, true);
+		return 1;
+	}
+	ts_tree_cursor_goto_descendant(c, start);
+	lua_pushboolean(L, false);
 	return 1;
 }
 
-/* @teal-export Cursor.goto_first_child: function(Cursor): boolean [[
+/* @teal-export Cursor.goto_first_child: function(Cursor, filter?: SymbolSet | ChildFilter): boolean [[
    Position the cursor at the first child of the current node
+
+   When a filter is given, the cursor is positioned at the first child that passes it
+   (see <code>Node.children</code>). If there is no such child the cursor is not moved
 ]] */
 static int tree_cursor_goto_first_child(lua_State *L) {
+	lua_settop(L, 2);
 	TSTreeCursor *const c = tree_cursor_assert(L, 1);
-	lua_pushboolean(L, ts_tree_cursor_goto_first_child(c));
+	ChildFilter const filter = check_filter(L, c, 2);
+	if (!ts_tree_cursor_goto_first_child(c)) {
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	if (!tree_cursor_skip_to_match(c, &filter)) {
+		ts_tree_cursor_goto_parent(c);
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	lua_pushboolean(L, true);
 	return 1;
 }
 
@@ -1,6 +1,7 @@
 #ifndef LTREESITTER_TREE_CURSOR_H
 #define LTREESITTER_TREE_CURSOR_H
 
+#include "symbol_set.h"
 #include "types.h"
 
 // ( -- table )
@@ -11,4 +12,20 @@ def_check_assert(TSTreeCursor, tree_cursor, LTREESITTER_TREE_CURSOR_METATABLE_NA
 // ( [kept_idx]=any -- tree_cursor )
 TSTreeCursor *tree_cursor_push(lua_State *L, int kept_idx, TSNode n);
 
+// Which children to stop at when iterating over them or moving a cursor to them
+typedef struct {
+	SymbolSet const *symbols; // NULL to allow any type
+	TSFieldId field;          // 0 to allow any field
+	bool named_only;
+} ChildFilter;
+
+// ( [idx]=?SymbolSet|ChildFilter | -- ?SymbolSet )
+// Read the filter at idx for the children of a node of `lang`. Pushes the set the
+// filter points to (or nil), which must be kept alive for as long as the filter is used
+ChildFilter child_filter_check(lua_State *L, int idx, TSLanguage const *lang);
+
+// Move the cursor forward over its siblings until it is on a node that passes
+// `filter`, staying put if it already is. Returns false if no such sibling was found
+bool tree_cursor_skip_to_match(TSTreeCursor *, ChildFilter const *filter);
+
 #endif
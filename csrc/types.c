@@ -65,14 +65,34 @@ TSPoint topoint(lua_State *L, int const idx) {
 }
 
 void push_match(lua_State *L, TSQueryMatch m, TSQuery const *q, int tree_index) {
+	tree_index = absindex(L, tree_index);
 	lua_createtable(L, 0, 5); // { <match> }
+	fill_match(L, m, q, tree_index);
+}
+
+void fill_match(lua_State *L, TSQueryMatch m, TSQuery const *q, int tree_index) {
+	tree_index = absindex(L, tree_index);
 	pushinteger(L, m.id);
 	lua_setfield(L, -2, "id"); // { <match> }
 	pushinteger(L, m.pattern_index);
 	lua_setfield(L, -2, "pattern_index"); // { <match> }
 	pushinteger(L, m.capture_count);
-	lua_setfield(L, -2, "capture_count");   // { <match> }
-	lua_createtable(L, 0, m.capture_count); // { <match> }, { <capture-map> }
+	lua_setfield(L, -2, "capture_count"); // { <match> }
+
+	lua_getfield(L, -1, "captures"); // { <match> }, ?{ <capture-map> }
+	if (lua_type(L, -1) == LUA_TTABLE) {
+		// reuse the old capture map
+		lua_pushnil(L);
+		while (lua_next(L, -2)) {  // { <match> }, { <capture-map> }, key, value
+			lua_pop(L, 1);         // { <match> }, { <capture-map> }, key
+			lua_pushvalue(L, -1);  // { <match> }, { <capture-map> }, key, key
+			lua_pushnil(L);        // { <match> }, { <capture-map> }, key, key, nil
+			lua_rawset(L, -4);     // { <match> }, { <capture-map> }, key
+		}
+	} else {
+		lua_pop(L, 1);
+		lua_createtable(L, 0, m.capture_count); // { <match> }, { <capture-map> }
+	}
 
 	for (uint16_t i = 0; i < m.capture_count; ++i) {
 #define push_current_node() node_push(L, tree_index, m.captures[i].node)
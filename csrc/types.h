@@ -22,7 +22,17 @@ typedef struct ltreesitter_Tree ltreesitter_Tree;
 #define LTREESITTER_NODE_METATABLE_NAME "ltreesitter.Node"
 #define LTREESITTER_QUERY_METATABLE_NAME "ltreesitter.Query"
 #define LTREESITTER_QUERY_CURSOR_METATABLE_NAME "ltreesitter.QueryCursor"
+#define LTREESITTER_QUERY_CURSOR_POOL_METATABLE_NAME "ltreesitter.QueryCursorPool"
+#define LTREESITTER_QUERY_RUN_METATABLE_NAME "ltreesitter.QueryRun"
 #define LTREESITTER_DYNLIB_METATABLE_NAME "ltreesitter.Dynlib"
+#define LTREESITTER_PARSE_FUTURE_METATABLE_NAME "ltreesitter.ParseFuture"
+#define LTREESITTER_PARSE_POOL_METATABLE_NAME "ltreesitter.ParsePool"
+#define LTREESITTER_CANCELLATION_FLAG_METATABLE_NAME "ltreesitter.CancellationFlag"
+#define LTREESITTER_PIECE_TABLE_METATABLE_NAME "ltreesitter.PieceTable"
+#define LTREESITTER_PIECE_TABLE_SNAPSHOT_METATABLE_NAME "ltreesitter.PieceTableSnapshot"
+#define LTREESITTER_CHUNK_CACHE_METATABLE_NAME "ltreesitter.ChunkCache"
+#define LTREESITTER_SYMBOL_SET_METATABLE_NAME "ltreesitter.SymbolSet"
+#define LTREESITTER_PARSE_BATCH_METATABLE_NAME "ltreesitter.ParseBatch"
 
 // garbage collected source text for trees and queries to hold on to
 typedef struct {
@@ -31,10 +41,31 @@ typedef struct {
 } SourceText;
 #define LTREESITTER_SOURCE_TEXT_METATABLE_NAME "ltreesitter.SourceText"
 
+// Arena of nodes for the integer node handles handed out by Tree:handle_*
+// A handle is just an index into `nodes`
+//
+// `index` is an open addressed hash set of handles + 1 (0 being empty),
+// keyed by node id, so that a node that already has a handle reuses it
+// rather than growing the arena every time it is navigated to
+typedef struct {
+	TSNode *nodes;
+	uint32_t length, capacity;
+	uint32_t *index;
+	uint32_t index_capacity; // 0 or a power of 2
+} NodeArena;
+
 struct ltreesitter_Tree {
 	TSTree *tree;
-	// TODO: the source text is kept in the registry, we don't need this
-	SourceText const *text_or_null_if_function_reader;
+	// Points into the object kept alive by the tree (either the Lua string
+	// given to Parser:parse_string, or a SourceText), so it is valid for as
+	// long as the tree is. NULL when the tree was parsed with a reader function
+	char const *text_or_null_if_function_reader;
+	uint32_t text_length;
+	TSInputEncoding encoding; // of the text
+	// when parsed with the `integer_points` option, the reader is called as
+	// reader(byte, row, column) rather than reader(byte, Point)
+	bool reader_takes_integer_points;
+	NodeArena handles;
 };
 
 // TODO: TSTreeCursor
@@ -50,6 +81,10 @@ def_check_assert(SourceText, source_text, LTREESITTER_SOURCE_TEXT_METATABLE_NAME
 
 TSPoint topoint(lua_State *L, int idx);
 
+// ( -- Match )
 void push_match(lua_State *L, TSQueryMatch, TSQuery const *, int tree_index);
+// ( Match -- Match )
+// Overwrite the fields of an existing match table, reusing its captures table
+void fill_match(lua_State *L, TSQueryMatch, TSQuery const *, int tree_index);
 
 #endif
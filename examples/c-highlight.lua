@@ -87,6 +87,11 @@ local ansi_colors = {
 	-- label = ?
 }
 
+local capture_colors = {}
+for i, name in ipairs(query:capture_names()) do
+	capture_colors[i] = ansi_colors[name]
+end
+
 local csi = string.char(27) .. "["
 
 for i = 1, select("#", ...) do
@@ -99,10 +104,10 @@ for i = 1, select("#", ...) do
 
 	local decoration = {}
 
-	for cap, name in query:capture(tree:root()) do
-		local color = ansi_colors[name]
+	for index, start_byte, end_byte in query:capture_ranges(tree:root()) do
+		local color = capture_colors[index]
 		if color then
-			for i = cap:start_index(), cap:end_index() do
+			for i = start_byte + 1, end_byte do
 				decoration[i] = color
 			end
 		end
@@ -8,7 +8,6 @@
 local ts = require "ltreesitter"
 local c = ts.require "c"
 
-local parser = c:parser()
 local query = c:query[[
 ((cast_expression
    value: (call_expression function: (identifier) @function-name) @cast)
@@ -318,16 +317,45 @@ for k, v in pairs(predicates) do
 	end
 end
 
-for i = 1, select("#", ...) do
-	current_file_name = select(i, ...)
-	local file = assert(io.open(current_file_name, "r"))
-	local contents = file:read("*a")
-	file:close()
+local paths = { ... }
+local file_trees, errors = c:parse_files(paths)
+local trees, tree_paths = {}, {}
+for i, path in ipairs(paths) do
+	if errors[i] then
+		success = false
+		io.stderr:write(errors[i], "\n")
+	else
+		table.insert(trees, file_trees[i])
+		table.insert(tree_paths, path)
+	end
+end
 
-	local tree = parser:parse_string(contents)
-	query:exec(tree:root(), predicates)
+-- The query is run over every file at once with Query:run_many, then the
+-- checks are called for the matches of each file in turn, so each pattern's
+-- check and its arguments are looked up ahead of time
+local checks = {}
+local ignored = {}
+for pattern_index = 0, query:pattern_count() - 1 do
+	for _, predicate in ipairs(query:predicates_for_pattern(pattern_index)) do
+		if predicates[predicate[1]] then
+			checks[pattern_index] = predicate
+			ignored[predicate[1]] = function() end
+		end
+	end
+end
 
-	-- print(tree)
+local unpack = table.unpack or unpack
+for i, matches in ipairs(query:run_many(trees, { predicates = ignored })) do
+	current_file_name = tree_paths[i]
+	for _, match in ipairs(matches) do
+		local check = checks[match.pattern_index]
+		local args = {}
+		for j = 2, #check do
+			local arg = check[j]
+			args[j - 1] = type(arg) == "table" and match.captures[arg.capture_name] or arg
+		end
+		predicates[check[1]](unpack(args, 1, #check - 1))
+	end
 end
 
 os.exit(success and 0 or 1)
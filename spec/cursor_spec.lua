@@ -3,15 +3,14 @@ local ts = require("ltreesitter")
 local util = require("spec.util")
 
 describe("Cursor", function()
-	local p
+	local lang, p
 	local str = {
 		[[ /* this is a comment */ int main(void) { return 0; } ]],
 	}
 	local tree = {}
 	local root = {}
 	setup(function()
-		local _
-		_, p = util.load_c_parser()
+		lang, p = util.load_c_parser()
 		for i, v in ipairs(str) do
 			tree[i] = assert(p:parse_string(v))
 			root[i] = assert(tree[i]:root())
@@ -60,6 +59,19 @@ describe("Cursor", function()
 			assert(c:goto_first_child())
 			assert(not c:goto_first_child())
 		end)
+		it("should skip to the first child in the given SymbolSet", function()
+			local c = assert(root[1]:create_cursor(), "Unable to create cursor from node")
+			assert(not c:goto_first_child(lang:symbol_set("compound_statement")))
+			assert.are.equal(root[1], c:current_node())
+			assert(c:goto_first_child(lang:symbol_set("function_definition")))
+			assert.are.equal("function_definition", c:current_node():type())
+		end)
+		it("should skip to the first child with the given field", function()
+			local c = assert(root[1]:child(1):create_cursor(), "Unable to create cursor from node")
+			assert(c:goto_first_child{ field = "body" })
+			assert.are.equal("compound_statement", c:current_node():type())
+			assert.are.equal("body", c:current_field_name())
+		end)
 	end)
 
 	describe("goto_next_sibling", function()
@@ -70,6 +82,14 @@ describe("Cursor", function()
 			assert(c:goto_next_sibling())
 			assert(not c:goto_next_sibling())
 		end)
+		it("should skip to the next sibling in the given SymbolSet", function()
+			local c = assert(root[1]:child(1):create_cursor(), "Unable to create cursor from node")
+			assert(c:goto_first_child())
+			assert(c:goto_next_sibling(lang:symbol_set("compound_statement")))
+			assert.are.equal("compound_statement", c:current_node():type())
+			assert(not c:goto_next_sibling(lang:symbol_set("primitive_type")))
+			assert.are.equal("compound_statement", c:current_node():type())
+		end)
 	end)
 	describe("goto_parent", function()
 		it("should return true on success and false on failure", function()
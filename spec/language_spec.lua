@@ -73,9 +73,67 @@ describe("Language", function()
 			end
 		end)
 	end)
+	describe("symbol_set", function()
+		it("should contain exactly the given types", function()
+			local set = util.assert_userdata_type(lang:symbol_set{ "identifier", "primitive_type" }, "ltreesitter.SymbolSet")
+			assert.is["true"](set:contains(lang:symbol_for_name("identifier", true)))
+			assert.is["true"](set:contains(lang:symbol_for_name("primitive_type", true)))
+			assert.is["false"](set:contains(lang:symbol_for_name("number_literal", true)))
+			assert.is["false"](set:contains(-1))
+		end)
+		it("should accept single types and symbols", function()
+			local sym = lang:symbol_for_name("number_literal", true)
+			assert.is["true"](lang:symbol_set("number_literal"):contains(sym))
+			assert.is["true"](lang:symbol_set(sym):contains(sym))
+		end)
+		it("should error on unknown node types", function()
+			assert.has.errors(function()
+				lang:symbol_set{ "identifier", "not_a_node_type" }
+			end)
+		end)
+	end)
 	describe("next_state", function()
 		it("should return an integer", function()
 			assert.is.number(lang:next_state(1, 1))
 		end)
 	end)
+	describe("parse_many", function()
+		it("should return a tree for each source, in order", function()
+			local sources = {}
+			for i = 1, 50 do
+				sources[i] = ("int x%d = %d;"):format(i, i)
+			end
+			local trees = lang:parse_many(sources, 4)
+			assert.are.equal(#sources, #trees)
+			for i, tree in ipairs(trees) do
+				util.assert_userdata_type(tree, "ltreesitter.Tree")
+				assert.are.equal(sources[i], tree:root():source())
+			end
+		end)
+		it("should work with a single thread and no sources", function()
+			assert.are.same({}, lang:parse_many({}, 1))
+			assert.are.equal("int x;", lang:parse_many({ "int x;" }, 1)[1]:root():source())
+		end)
+		it("should error on non-string sources", function()
+			assert.has_error(function()
+				lang:parse_many({ "int x;", 1 })
+			end)
+		end)
+	end)
+	describe("parse_files", function()
+		it("should read and parse each file, and report the ones that can't be read", function()
+			local path = os.tmpname()
+			local src = "int main(void) {\n\treturn 0;\n}\n"
+			local f = assert(io.open(path, "wb"))
+			f:write(src)
+			f:close()
+			local trees, errors = lang:parse_files({ path, "this/file/does/not/exist.c", path }, 2)
+			os.remove(path)
+			assert.are.equal(src, trees[1]:root():source())
+			assert.is["nil"](trees[2])
+			assert.are.equal(src, trees[3]:root():source())
+			assert.is.string(errors[2])
+			assert.is["nil"](errors[1])
+		end)
+	end)
 end)
@@ -98,6 +98,116 @@ describe("Node", function()
 		})
 	end)
 
+	describe("children filters", function()
+		it("should only iterate over children in the given SymbolSet", function()
+			local set = c_lang:symbol_set{ "function_declarator", "compound_statement" }
+			local n = assert(root[2]:child(1))
+			for _, iterate in ipairs{ n.children, n.named_children } do
+				local types = {}
+				for child in iterate(n, set) do
+					util.assert_userdata_type(child, "ltreesitter.Node")
+					table.insert(types, child:type())
+				end
+				assert.are.same({ "function_declarator", "compound_statement" }, types)
+			end
+		end)
+		it("should iterate over nothing when no children are in the set", function()
+			local set = c_lang:symbol_set("number_literal")
+			assert.is["nil"](root[2]:child(1):children(set)())
+			assert.is["nil"](root[2]:child(1):named_children(set)())
+		end)
+		it("should only iterate over children with the given field", function()
+			local n = assert(root[2]:child(1))
+			local by_name, by_id = {}, {}
+			for child in n:children{ field = "body" } do
+				table.insert(by_name, child:type())
+			end
+			for child in n:named_children{ field = c_lang:field_id_for_name("declarator") } do
+				table.insert(by_id, child:type())
+			end
+			assert.are.same({ "compound_statement" }, by_name)
+			assert.are.same({ "function_declarator" }, by_id)
+		end)
+		it("should only iterate over named children with named_only", function()
+			local body = assert(root[2]:child(1):child(2))
+			local all, named = {}, {}
+			for child in body:children() do
+				table.insert(all, child:type())
+			end
+			for child in body:children{ named_only = true } do
+				table.insert(named, child:type())
+			end
+			assert.are.same({ "{", "return_statement", "}" }, all)
+			assert.are.same({ "return_statement" }, named)
+		end)
+		it("should combine filters", function()
+			local body = assert(root[2]:child(1):child(2))
+			assert.is["nil"](body:children{ types = { "{", "}" }, named_only = true }())
+			local types = {}
+			for child in body:children{ types = { "{", "}" } } do
+				table.insert(types, child:type())
+			end
+			assert.are.same({ "{", "}" }, types)
+		end)
+		it("should error on unknown fields and non-SymbolSet filters", function()
+			assert.has.errors(function()
+				root[2]:child(1):children{ field = "not_a_field" }
+			end)
+			assert.has.errors(function()
+				root[2]:child(1):children("compound_statement")
+			end)
+		end)
+	end)
+	it("named_children should give the same nodes as named_child on wide nodes", function()
+		local decls = {}
+		for i = 1, 1000 do
+			decls[i] = ("int x%d;"):format(i)
+		end
+		local wide = p:parse_string(table.concat(decls, "\n")):root()
+		local i = 0
+		for child in wide:named_children() do
+			assert.are.equal(wide:named_child(i), child)
+			i = i + 1
+		end
+		assert.are.equal(wide:named_child_count(), i)
+	end)
+	describe("children_array", function()
+		it("should return the same nodes as children", function()
+			local body = assert(root[2]:child(1):child(2))
+			local expected = {}
+			for child in body:children() do
+				table.insert(expected, child)
+			end
+			local arr = body:children_array()
+			assert.are.equal(3, #arr)
+			assert.are.same(expected, arr)
+		end)
+		it("should only return named children with named_only", function()
+			local body = assert(root[2]:child(1):child(2))
+			local arr = body:children_array(true)
+			assert.are.equal(1, #arr)
+			assert.are.equal("return_statement", arr[1]:type())
+			assert.are.same({}, root[2]:child(0):children_array())
+		end)
+	end)
+	describe("field_children", function()
+		it("should return every child with the field", function()
+			local decl = assert(p:parse_string("int a, b = 1, c;"):root():child(0))
+			local names = {}
+			for i, child in ipairs(decl:field_children("declarator")) do
+				util.assert_userdata_type(child, "ltreesitter.Node")
+				names[i] = child:source()
+			end
+			assert.are.same({ "a", "b = 1", "c" }, names)
+			assert.are.equal(3, #decl:field_children(c_lang:field_id_for_name("declarator")))
+			assert.are.same({}, decl:field_children("body"))
+		end)
+		it("should error on unknown fields", function()
+			assert.has.errors(function()
+				root[2]:child(1):field_children("not_a_field")
+			end)
+		end)
+	end)
 	it("create_cursor should return an ltreesitter.TreeCursor", function()
 		util.assert_userdata_type(root[1]:create_cursor(), "ltreesitter.TreeCursor")
 	end)
@@ -152,6 +262,28 @@ describe("Node", function()
 			assert.is.number(point.column)
 		end)
 	end)
+	describe("start_row_col", function()
+		it("should return the fields of start_point", function()
+			local point = root[3]:child(1):start_point()
+			assert.are.same({ point.row, point.column }, { root[3]:child(1):start_row_col() })
+		end)
+	end)
+	describe("end_row_col", function()
+		it("should return the fields of end_point", function()
+			local point = root[3]:child(1):end_point()
+			assert.are.same({ point.row, point.column }, { root[3]:child(1):end_row_col() })
+		end)
+	end)
+	describe("range", function()
+		it("should return the start and end rows, columns, and bytes", function()
+			local n = root[3]:child(1)
+			local s, e = n:start_point(), n:end_point()
+			assert.are.same(
+				{ s.row, s.column, n:start_byte_offset(), e.row, e.column, n:end_byte_offset() },
+				{ n:range() }
+			)
+		end)
+	end)
 	describe("source", function()
 		it("should return a string", function()
 			local src = root[1]:source()
@@ -270,4 +402,73 @@ describe("Node", function()
 			assert.is.string(root[1]:grammar_type())
 		end)
 	end)
+	describe("descendants_of_type", function()
+		local src = [[
+			int add(int a, int b) { return a + b; }
+			int main(void) { return add(1, add(2, 3)); }
+		]]
+		it("should find the descendants with the given types in pre-order", function()
+			local tree_root = p:parse_string(src):root()
+			local expected = {}
+			local function collect(node)
+				for child in node:children() do
+					if child:type() == "call_expression" or child:type() == "number_literal" then
+						table.insert(expected, child:source())
+					end
+					collect(child)
+				end
+			end
+			collect(tree_root)
+
+			local found = {}
+			for _, n in ipairs(tree_root:descendants_of_type{ "call_expression", "number_literal" }) do
+				util.assert_userdata_type(n, "ltreesitter.Node")
+				table.insert(found, n:source())
+			end
+			assert.are.same(expected, found)
+		end)
+		it("should accept symbols and single types", function()
+			local tree_root = p:parse_string(src):root()
+			local by_name = tree_root:descendants_of_type("call_expression")
+			local by_symbol = tree_root:descendants_of_type{ by_name[1]:symbol() }
+			assert.are.equal(2, #by_name)
+			assert.are.equal(#by_name, #by_symbol)
+			assert.are.equal(by_name[2], by_symbol[2])
+		end)
+		it("should accept a SymbolSet", function()
+			local tree_root = p:parse_string(src):root()
+			local set = c_lang:symbol_set{ "call_expression", "number_literal" }
+			assert.are.same(
+				tree_root:descendants_of_type{ "call_expression", "number_literal" },
+				tree_root:descendants_of_type(set)
+			)
+		end)
+		it("should not include the node itself", function()
+			local call = p:parse_string(src):root():descendants_of_type("call_expression")[1]
+			local nested = call:descendants_of_type("call_expression")
+			assert.are.equal(1, #nested)
+			assert.are.equal("add(2, 3)", nested[1]:source())
+		end)
+		it("should stop after max nodes", function()
+			local tree_root = p:parse_string(src):root()
+			assert.are.equal(3, #tree_root:descendants_of_type("identifier", 3))
+			assert.are.equal(0, #tree_root:descendants_of_type("identifier", 0))
+		end)
+		it("should error on unknown node types", function()
+			assert.has.errors(function()
+				root[1]:descendants_of_type("not_a_node_type")
+			end)
+		end)
+	end)
+	describe("source_utf8", function()
+		it("should return the same as source for utf-8 trees", function()
+			assert.are.equal(root[2]:child(1):source(), root[2]:child(1):source_utf8())
+		end)
+		it("should transcode the source of utf-16 trees", function()
+			local src = "\0/\0/\0 \0c\0a\0f\0\233\0\n"
+			local utf16_root = assert(p:parse_string(src, "utf-16be")):root()
+			assert.are.equal(src:sub(1, 14), utf16_root:child(0):source())
+			assert.are.equal("// café", utf16_root:child(0):source_utf8())
+		end)
+	end)
 end)
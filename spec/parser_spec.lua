@@ -1,5 +1,5 @@
 local assert = require("luassert")
--- local ts = require("ltreesitter")
+local ts = require("ltreesitter")
 local util = require("spec.util")
 
 describe("Parser", function()
@@ -110,5 +110,201 @@ describe("Parser", function()
 				2
 			)
 		end)
+		it("should stop parsing once the cancellation flag is set", function()
+			local flag = ts.cancellation_flag()
+			local tree, reason = p:parse_with(function(byte_idx)
+				if byte_idx > 1000 then
+					flag:set()
+				end
+				if byte_idx < 1000000 then
+					return "int x;\n"
+				end
+			end, nil, nil, nil, { cancellation_flag = flag })
+			assert.is["nil"](tree)
+			assert.are.equal("cancelled", reason)
+			p:reset()
+		end)
+		it("should pass the row and column as integers with the integer_points option", function()
+			local lines = {
+				"int x;\n",
+				"int main(void) { return x; }\n",
+			}
+			local function read_lines(_byte_idx, row, column)
+				assert.is.number(row)
+				assert.is.number(column)
+				local ln = lines[row + 1]
+				if ln then
+					return ln:sub(column + 1, column + math.random(1, 10))
+				end
+			end
+			local tree = p:parse_with(read_lines, nil, nil, nil, { integer_points = true })
+			local src = table.concat(lines)
+			assert.are.equal(tostring(p:parse_string(src):root()), tostring(tree:root()))
+			assert.are.equal("int main(void) { return x; }", tree:root():child(1):source())
+		end)
+		describe("chunk_cache_bytes", function()
+			local src = "int x;\nint main(void) { return x; }\n"
+			local calls
+			local function reader(byte_idx)
+				calls = calls + 1
+				return src:sub(byte_idx + 1, byte_idx + 5)
+			end
+			before_each(function()
+				calls = 0
+			end)
+			it("should get node sources without calling the reader again", function()
+				local tree = p:parse_with(reader, nil, nil, nil, { chunk_cache_bytes = 1024 })
+				local calls_while_parsing = calls
+				assert.are.equal(src, tree:root():source())
+				assert.are.equal("int main(void) { return x; }", tree:root():child(1):source())
+				assert.are.equal(calls_while_parsing, calls)
+			end)
+			it("should fall back to the reader for text that didn't fit", function()
+				local tree = p:parse_with(reader, nil, nil, nil, { chunk_cache_bytes = 8 })
+				local calls_while_parsing = calls
+				assert.are.equal(src, tree:root():source())
+				assert.are.equal("int x;", tree:root():child(0):source())
+				assert.are.equal("int main(void) { return x; }", tree:root():child(1):source())
+				assert.is.truthy(calls > calls_while_parsing)
+			end)
+			it("should error when not given a non-negative integer", function()
+				for _, bytes in ipairs{ -1, 1.5, 0 / 0, math.huge, "1024" } do
+					assert.has.errors(function()
+						p:parse_with(reader, nil, nil, nil, { chunk_cache_bytes = bytes })
+					end)
+				end
+			end)
+		end)
+	end)
+	describe("parse options", function()
+		local big_src = ("int x = 1;\n"):rep(200000)
+		it("should not change the result when the limits aren't hit", function()
+			local src = "int main(void) { return 0; }"
+			local flag = ts.cancellation_flag()
+			local tree = p:parse_string(src, nil, nil, { timeout_micros = 60 * 1000000, cancellation_flag = flag })
+			assert.are.equal(tostring(p:parse_string(src):root()), tostring(tree:root()))
+		end)
+		it("should stop parse_string when the timeout is hit", function()
+			local tree, reason = p:parse_string(big_src, nil, nil, { timeout_micros = 0 })
+			assert.is["nil"](tree)
+			assert.are.equal("timed out", reason)
+			-- the parser is reset, so the next parse starts over
+			assert.are.equal("int x;", p:parse_string("int x;"):root():source())
+		end)
+		it("should stop parse_with when the timeout is hit and start over on the next parse", function()
+			local function reader_for(src)
+				return function(i)
+					return src:sub(i + 1, i + 4096)
+				end
+			end
+			local tree, reason = p:parse_with(reader_for(big_src), nil, nil, nil, { timeout_micros = 0 })
+			assert.is["nil"](tree)
+			assert.are.equal("timed out", reason)
+			local src = "int main(void) { return 0; }"
+			assert.are.equal(tostring(p:parse_string(src):root()), tostring(p:parse_with(reader_for(src)):root()))
+			assert.are.equal(src, p:parse_string(src):root():source())
+		end)
+		it("should stop parse_string when the cancellation flag is already set", function()
+			local flag = ts.cancellation_flag()
+			flag:set()
+			assert.is["true"](flag:is_set())
+			local tree, reason = p:parse_string(big_src, nil, nil, { cancellation_flag = flag })
+			assert.is["nil"](tree)
+			assert.are.equal("cancelled", reason)
+			flag:reset()
+			assert.is["false"](flag:is_set())
+		end)
+		it("should stop parse_string_async when the cancellation flag is set", function()
+			local flag = ts.cancellation_flag()
+			flag:set()
+			local tree, reason = p:parse_string_async(big_src, nil, nil, { cancellation_flag = flag }):wait()
+			assert.is["nil"](tree)
+			assert.are.equal("cancelled", reason)
+		end)
+		it("should error on invalid options", function()
+			assert.has.errors(function()
+				p:parse_string("int x;", nil, nil, { cancellation_flag = {} })
+			end)
+			for _, micros in ipairs{ -1, 1.5, 0 / 0, math.huge, 2 ^ 64, "1000" } do
+				assert.has.errors(function()
+					p:parse_string("int x;", nil, nil, { timeout_micros = micros })
+				end)
+			end
+		end)
+	end)
+	describe("parse_string_async", function()
+		it("should give the same tree as parse_string", function()
+			local src = "int main(void) { return 0; }"
+			local future = util.assert_userdata_type(p:parse_string_async(src), "ltreesitter.ParseFuture")
+			local tree = util.assert_userdata_type(future:wait(), "ltreesitter.Tree")
+			assert.is["true"](future:ready())
+			assert(rawequal(tree, future:wait()))
+			assert.are.equal(tostring(p:parse_string(src):root()), tostring(tree:root()))
+			assert.are.equal(src, tree:root():source())
+		end)
+		it("should be able to run many parses at once", function()
+			local futures = {}
+			for i = 1, 32 do
+				futures[i] = p:parse_string_async(("int x%d = %d;"):format(i, i))
+			end
+			for i = 1, 32 do
+				assert.are.equal(("int x%d = %d;"):format(i, i), futures[i]:wait():root():source())
+			end
+		end)
+		it("should not crash when a future is collected before it finishes", function()
+			local src = ("int x = 1;\n"):rep(10000)
+			for _ = 1, 8 do
+				p:parse_string_async(src)
+			end
+			collectgarbage("collect")
+			collectgarbage("collect")
+		end)
+	end)
+	describe("reparse", function()
+		it("should give the same tree as parsing the edited source", function()
+			local src = "int main(void) {\n\treturn 0;\n}\n"
+			local tree = p:parse_string(src)
+			local new_tree, changed = p:reparse(tree, 25, 26, "x + 1")
+			local new_src = "int main(void) {\n\treturn x + 1;\n}\n"
+			assert.are.equal(new_src, new_tree:root():source())
+			assert.are.equal(tostring(p:parse_string(new_src):root()), tostring(new_tree:root()))
+			assert.is.table(changed)
+			-- the original tree is untouched
+			assert.are.equal(src, tree:root():source())
+		end)
+		it("should compute the points of the edit", function()
+			local tree = p:parse_string("int x;\nint y;\n")
+			local new_tree = p:reparse(tree, 7, 7, "int z;\n")
+			local decl = new_tree:root():child(2)
+			assert.are.equal("int y;", decl:source())
+			assert.are.same({ row = 2, column = 0 }, decl:start_point())
+		end)
+		it("should error when the range is out of bounds", function()
+			local tree = p:parse_string("int x;")
+			assert.has.errors(function()
+				p:reparse(tree, 3, 100, "")
+			end)
+			assert.has.errors(function()
+				p:reparse(tree, 4, 3, "")
+			end)
+		end)
+	end)
+	describe("parse_file", function()
+		it("should parse the contents of the file", function()
+			local path = os.tmpname()
+			local src = "int main(void) {\n\treturn 0;\n}\n"
+			local f = assert(io.open(path, "wb"))
+			f:write(src)
+			f:close()
+			local tree = util.assert_userdata_type(p:parse_file(path), "ltreesitter.Tree")
+			os.remove(path)
+			assert.are.equal(src, tree:root():source())
+			assert.are.equal(tree:root():source(), p:parse_string(src):root():source())
+		end)
+		it("should return nil and an error message when the file can't be read", function()
+			local tree, err = p:parse_file("this/file/does/not/exist.c")
+			assert.is["nil"](tree)
+			assert.is.string(err)
+		end)
 	end)
 end)
@@ -0,0 +1,82 @@
+local assert = require("luassert")
+local ts = require("ltreesitter")
+local util = require("spec.util")
+
+describe("PieceTable", function()
+	it("should hold the text it was created with", function()
+		local pt = util.assert_userdata_type(ts.piece_table("int x;\n"), "ltreesitter.PieceTable")
+		assert.are.equal("int x;\n", tostring(pt))
+		assert.are.equal(7, pt:length())
+		assert.are.equal("", tostring(ts.piece_table()))
+	end)
+	it("should insert, delete, and replace text", function()
+		local pt = ts.piece_table("int x;\n")
+		pt:insert(7, "int y;\n")
+		pt:insert(0, "// hi\n")
+		assert.are.equal("// hi\nint x;\nint y;\n", tostring(pt))
+		pt:delete(0, 6)
+		assert.are.equal("int x;\nint y;\n", tostring(pt))
+		pt:replace(4, 5, "abc")
+		assert.are.equal("int abc;\nint y;\n", tostring(pt))
+		assert.are.equal("abc", pt:sub(4, 7))
+		assert.are.equal(tostring(pt), pt:sub())
+	end)
+	it("should keep consecutive inserts in order", function()
+		local pt = ts.piece_table()
+		local expected = {}
+		for i = 1, 200 do
+			local s = tostring(i) .. "\n"
+			pt:insert(pt:length(), s)
+			table.insert(expected, s)
+		end
+		assert.are.equal(table.concat(expected), tostring(pt))
+	end)
+	it("should return the arguments to Tree:edit", function()
+		local pt = ts.piece_table("int x;\nint y;\n")
+		assert.are.same(
+			{ 11, 12, 15, 1, 4, 1, 5, 2, 2 },
+			{ pt:replace(11, 12, "a\nbc") }
+		)
+		assert.are.same(
+			{ 0, 7, 0, 0, 0, 1, 0, 0, 0 },
+			{ pt:delete(0, 7) }
+		)
+	end)
+	it("should error on out of range offsets", function()
+		local pt = ts.piece_table("abc")
+		assert.has.errors(function() pt:insert(4, "x") end)
+		assert.has.errors(function() pt:delete(2, 1) end)
+		assert.has.errors(function() pt:replace(-1, 1, "x") end)
+	end)
+
+	describe("Parser:parse_piece_table", function()
+		local p
+		setup(function()
+			local _
+			_, p = util.load_c_parser()
+		end)
+		it("should give the same tree as parsing a string", function()
+			local src = "int main(void) {\n\treturn 0;\n}\n"
+			local tree = util.assert_userdata_type(p:parse_piece_table(ts.piece_table(src)), "ltreesitter.Tree")
+			assert.are.equal(src, tree:root():source())
+			assert.are.equal(tostring(p:parse_string(src):root()), tostring(tree:root()))
+		end)
+		it("should reparse incrementally after edits", function()
+			local pt = ts.piece_table("int main(void) {\n\treturn 0;\n}\n")
+			local tree = p:parse_piece_table(pt)
+			tree:edit(pt:replace(25, 26, "x + 1"))
+			tree:edit(pt:insert(0, "int x;\n"))
+			local new_tree = p:parse_piece_table(pt, tree)
+			local new_src = "int x;\nint main(void) {\n\treturn x + 1;\n}\n"
+			assert.are.equal(new_src, new_tree:root():source())
+			assert.are.equal(tostring(p:parse_string(new_src):root()), tostring(new_tree:root()))
+		end)
+		it("should not see edits made after parsing", function()
+			local pt = ts.piece_table("int x;\n")
+			local tree = p:parse_piece_table(pt)
+			pt:replace(0, 7, "long y;\n")
+			assert.are.equal("int x;\n", tree:root():source())
+			assert.are.equal("x", tree:root():child(0):child(1):source())
+		end)
+	end)
+end)
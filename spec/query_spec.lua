@@ -108,6 +108,151 @@ describe("Query", function()
 			end
 			assert.are.equal(1, count)
 		end)
+		it("should not be affected by the range of a previous query", function()
+			local tree = assert(p:parse_string[[
+				// hello
+				// world
+				// hello
+			]])
+			local q = l:query[[ (comment) @a ]]
+			for _ = 1, 20 do
+				for _ in q:match(tree:root(), nil, 4, 11) do end
+				collectgarbage()
+			end
+			local count = 0
+			for _ in q:match(tree:root()) do
+				count = count + 1
+			end
+			assert.are.equal(3, count)
+		end)
+	end)
+	describe("matches_into", function()
+		local tree
+		setup(function()
+			tree = assert(p:parse_string[[
+				// hello
+				// world
+				// hello
+			]])
+		end)
+		it("should write every match into the given table", function()
+			local out = {}
+			local n = l:query[[ (comment) @a ]]:matches_into(tree:root(), out)
+			assert.are.equal(3, n)
+			assert.are.equal("// hello", out[1].captures.a:source())
+			assert.are.equal("// world", out[2].captures.a:source())
+			assert.are.equal("// hello", out[3].captures.a:source())
+		end)
+		it("should reuse the tables already in the given table", function()
+			local out = {}
+			local q = l:query[[ (comment) @a ]]
+			q:matches_into(tree:root(), out)
+			local first, first_captures = out[1], out[1].captures
+			local n = q:matches_into(tree:root(), out, 2, { ["unused?"] = function() end })
+			assert.are.equal(2, n)
+			assert(rawequal(first, out[1]))
+			assert(rawequal(first_captures, out[1].captures))
+			assert.are.equal("// hello", out[1].captures.a:source())
+		end)
+		it("should run predicates", function()
+			local out = {}
+			local n = l:query[[ ((comment) @a (#eq? @a "// world")) ]]:matches_into(tree:root(), out)
+			assert.are.equal(1, n)
+			assert.are.equal("// world", out[1].captures.a:source())
+		end)
+	end)
+	describe("run_many", function()
+		local trees
+		setup(function()
+			trees = {}
+			for i = 1, 20 do
+				trees[i] = assert(p:parse_string(("// a\n// comment %d\nint x%d;\n"):format(i, i)))
+			end
+		end)
+		it("should give the matches for each tree in order", function()
+			local results = l:query[[ (comment) @a ]]:run_many(trees, { threads = 4 })
+			assert.are.equal(#trees, #results)
+			for i, matches in ipairs(results) do
+				assert.are.equal(2, #matches)
+				assert.are.equal("// a", matches[1].captures.a:source())
+				assert.are.equal(("// comment %d"):format(i), matches[2].captures.a:source())
+				assert.are.equal(trees[i]:root():child(1), matches[2].captures.a)
+			end
+		end)
+		it("should evaluate builtin predicates", function()
+			local results = l:query[[ ((comment) @a (#not-eq? @a "// a")) ]]:run_many(trees)
+			for i, matches in ipairs(results) do
+				assert.are.equal(1, #matches)
+				assert.are.equal(("// comment %d"):format(i), matches[1].captures.a:source())
+			end
+		end)
+		it("should call Lua predicates on the calling thread", function()
+			local calls = 0
+			local results = l:query[[ ((comment) @a (#is-a? @a)) ]]:run_many(trees, {
+				predicates = {
+					["is-a?"] = function(node)
+						calls = calls + 1
+						return node:source() == "// a"
+					end,
+				},
+			})
+			assert.are.equal(2 * #trees, calls)
+			for _, matches in ipairs(results) do
+				assert.are.equal(1, #matches)
+				assert.are.equal("// a", matches[1].captures.a:source())
+			end
+		end)
+		it("should handle no trees", function()
+			assert.are.same({}, l:query[[ (comment) @a ]]:run_many({}))
+		end)
+	end)
+	describe("capture_names", function()
+		it("should return the name of each capture in order", function()
+			local q = l:query[[ (comment) @a (identifier) @b.c ]]
+			assert.are.same({ "a", "b.c" }, q:capture_names())
+		end)
+	end)
+	describe("capture_ranges", function()
+		it("should give the same captures as capture", function()
+			local tree = assert(p:parse_string[[
+				int main(void) {
+					// hi
+					return 0;
+				}
+			]])
+			local q = l:query[[ (comment) @comment (identifier) @ident ]]
+			local names = q:capture_names()
+			local expected = {}
+			for node, name in q:capture(tree:root()) do
+				local s, e = node:start_point(), node:end_point()
+				table.insert(expected, {
+					name, node:start_byte_offset(), node:end_byte_offset(),
+					s.row, s.column, e.row, e.column,
+				})
+			end
+			local got = {}
+			for index, start_byte, end_byte, start_row, start_col, end_row, end_col in q:capture_ranges(tree:root()) do
+				table.insert(got, {
+					names[index], start_byte, end_byte,
+					start_row, start_col, end_row, end_col,
+				})
+			end
+			assert.are.equal(2, #got)
+			assert.are.same(expected, got)
+		end)
+		it("should run predicates", function()
+			local tree = assert(p:parse_string[[
+				// foo
+				// bar
+			]])
+			local count = 0
+			for index, start_byte, end_byte in l:query[[ ((comment) @a (#eq? @a "// bar")) ]]:capture_ranges(tree:root()) do
+				count = count + 1
+				assert.are.equal(1, index)
+				assert.are.equal(end_byte - start_byte, #"// bar")
+			end
+			assert.are.equal(1, count)
+		end)
 	end)
 	describe("capture", function()
 		it("should return a function", function()
@@ -342,6 +487,63 @@ describe("Query", function()
 				assert.are.same(res, {})
 			end)
 		end)
+		describe("builtin variants", function()
+			local root_node
+			setup(function()
+				root_node = assert(p:parse_string[[
+					// foo
+					// bar
+					// baz
+					// bang
+					// blah
+					// hoop
+				]]):root()
+			end)
+			local function sources(query_src, predicates)
+				local res = {}
+				for c in l:query(query_src):capture(root_node, predicates) do
+					table.insert(res, c:source())
+				end
+				return res
+			end
+			it("not-eq? matches when arguments differ", function()
+				assert.are.same(
+					{"// foo", "// baz", "// bang", "// blah", "// hoop"},
+					sources[[ ((comment) @a (#not-eq? @a "// bar")) ]])
+			end)
+			it("any-of? matches any of its arguments", function()
+				assert.are.same(
+					{"// bar", "// hoop"},
+					sources[[ ((comment) @a (#any-of? @a "// hoop" "// bar" "// nope")) ]])
+			end)
+			it("lua-match? behaves like match?", function()
+				assert.are.same(
+					{"// bar", "// baz", "// bang", "// blah"},
+					sources[[ ((comment) @a (#lua-match? @a "^//%s*b%l+$")) ]])
+			end)
+			it("not-match? matches when the pattern does not", function()
+				assert.are.same(
+					{"// foo", "// hoop"},
+					sources[[ ((comment) @a (#not-match? @a "^// b")) ]])
+			end)
+			it("match? supports frontier patterns", function()
+				assert.are.same(
+					{"// bang"},
+					sources[[ ((comment) @a (#match? @a "%f[%w]bang%f[%W]")) ]])
+			end)
+			it("match? falls back to string.match for back references", function()
+				assert.are.same(
+					{"// foo", "// hoop"},
+					sources[[ ((comment) @a (#match? @a "(o)%1")) ]])
+			end)
+			it("can be overridden by a predicates table", function()
+				assert.are.same(
+					{"// foo", "// bar", "// baz", "// bang", "// blah", "// hoop"},
+					sources([[ ((comment) @a (#eq? @a "// bar")) ]], {
+						["eq?"] = function() return true end
+					}))
+			end)
+		end)
 		describe("user-defined", function()
 			local root_node
 			setup(function()
@@ -395,6 +597,48 @@ describe("Query", function()
 				end
 				assert.are.same(captures, { "// bar" })
 			end)
+			it("should be able to reuse a predicate table across queries and matches", function()
+				local calls = 0
+				local preds = {
+					["starts_with?"] = function(a, b)
+						calls = calls + 1
+						return a:source():match("^//%s*" .. b)
+					end
+				}
+				local q = l:query[[((comment) @a (#starts_with? @a "b"))]]
+				local function count(query)
+					local n = 0
+					for _ in query:match(root_node, preds) do
+						n = n + 1
+					end
+					return n
+				end
+				assert.are.equal(4, count(q))
+				assert.are.equal(4, count(q))
+				assert.are.equal(4, count(l:query[[((comment) @a (#starts_with? @a "b"))]]))
+				assert.are.equal(18, calls)
+			end)
+			it("should pass the same Node to every predicate using a capture", function()
+				local seen = {}
+				local function save(a) table.insert(seen, a) end
+				for _ in l
+					:query[[((comment) @a (#eq? @a "// bar") (#save! @a) (#save! @a))]]
+					:match(root_node, { ["save!"] = save })
+				do end
+				assert.are.equal(2, #seen)
+				assert(rawequal(seen[1], seen[2]))
+				assert.are.equal("// bar", seen[1]:source())
+			end)
+			it("should only error about a missing predicate when it is used", function()
+				local q = l:query[[((comment) @a (#eq? @a "// nothing") (#missing? @a))]]
+				assert.has_no.errors(function()
+					for _ in q:match(root_node) do end
+				end)
+				local q2 = l:query[[((comment) @a (#missing? @a))]]
+				assert.has.errors(function()
+					for _ in q2:match(root_node) do end
+				end)
+			end)
 		end)
 	end)
 	describe("exec", function()
@@ -467,4 +711,28 @@ describe("Query", function()
 			})
 		end)
 	end)
+	describe("utf-16 sources", function()
+		local function utf16le(s)
+			return (s:gsub(".", "%0\0"))
+		end
+		local root_node
+		setup(function()
+			local src = utf16le("// caf") .. "\233\0" .. utf16le("\n// other\n")
+			root_node = assert(p:parse_string(src, "utf-16le")):root()
+		end)
+		it("should compare captures with utf-8 literals", function()
+			local count = 0
+			for _ in l:query[[ ((comment) @a (#eq? @a "// café")) ]]:match(root_node) do
+				count = count + 1
+			end
+			assert.are.equal(1, count)
+		end)
+		it("should match patterns against the utf-8 text of captures", function()
+			local count = 0
+			for _ in l:query[[ ((comment) @a (#match? @a "^// o")) ]]:match(root_node) do
+				count = count + 1
+			end
+			assert.are.equal(1, count)
+		end)
+	end)
 end)
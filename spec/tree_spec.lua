@@ -3,10 +3,9 @@ local ts = require("ltreesitter")
 local util = require("spec.util")
 
 describe("Tree", function()
-	local p, t
+	local lang, p, t
 	setup(function()
-		local _
-		_, p = util.load_c_parser()
+		lang, p = util.load_c_parser()
 		t = assert(p:parse_string[[ int main(void) { return 0; } ]])
 	end)
 	it("copy should return a ltreesitter.TSTree", function()
@@ -21,6 +20,25 @@ describe("Tree", function()
 			"ltreesitter.Node"
 		)
 	end)
+	it("nodes should keep their tree alive", function()
+		local root = p:parse_string[[ int x = 1; ]]:root()
+		collectgarbage("collect")
+		collectgarbage("collect")
+		assert.are.equal(root:child(0):source(), "int x = 1;")
+	end)
+	it("trees should keep the string they were parsed from alive", function()
+		local parts = {}
+		for i = 1, 100 do parts[i] = ("int x%d = %d;"):format(i, i) end
+		local tree = p:parse_string(table.concat(parts, "\n"))
+		parts = nil
+		collectgarbage("collect")
+		collectgarbage("collect")
+		local copy = tree:copy()
+		tree = nil
+		collectgarbage("collect")
+		collectgarbage("collect")
+		assert.are.equal("int x100 = 100;", copy:root():child(99):source())
+	end)
 	it("get_changed_ranges should return changed ranges", function()
 		t:edit_s {
 			start_byte    = 18,
@@ -39,4 +57,184 @@ describe("Tree", function()
 			end_point   = { row = 0, column = 24 },
 		}}, c)
 	end)
+	describe("flatten", function()
+		local src = [[ int main(void) { return 0; } ]]
+		it("should visit every node in pre-order", function()
+			local tree = p:parse_string(src)
+			local flat = tree:flatten()
+			local expected = {}
+			local function walk(node, parent)
+				table.insert(expected, { node:symbol(), parent, node:start_byte_offset(), node:end_byte_offset(), node:is_named() })
+				local self = #expected
+				for child in node:children() do
+					walk(child, self)
+				end
+			end
+			walk(tree:root(), 0)
+			assert.are.equal(#expected, flat.count)
+			for i, e in ipairs(expected) do
+				assert.are.same(e, { flat.symbol[i], flat.parent[i], flat.start_byte[i], flat.end_byte[i], flat.is_named[i] })
+			end
+		end)
+		it("should only include named nodes when asked to", function()
+			local flat = p:parse_string(src):flatten{ named_only = true }
+			for i = 1, flat.count do
+				assert.is_true(flat.is_named[i])
+				assert(flat.parent[i] < i)
+			end
+		end)
+		it("should reuse the given table and clear stale entries", function()
+			local into = p:parse_string(src):flatten()
+			local symbols = into.symbol
+			local old_count = into.count
+			local result = p:parse_string[[ int x; ]]:flatten{ into = into }
+			assert.are.equal(into, result)
+			assert.are.equal(symbols, result.symbol)
+			assert(result.count < old_count)
+			assert.is_nil(result.symbol[result.count + 1])
+		end)
+	end)
+	describe("walk", function()
+		local src = [[
+			int add(int a, int b) { return a + b; }
+			int main(void) { return add(1, add(2, 3)); }
+		]]
+		it("should call handlers for nodes of the given types in pre-order", function()
+			local tree = p:parse_string(src)
+			local expected = {}
+			local function collect(node)
+				if node:type() == "call_expression" or node:type() == "identifier" then
+					table.insert(expected, node:source())
+				end
+				for child in node:children() do
+					collect(child)
+				end
+			end
+			collect(tree:root())
+
+			local visited = {}
+			local function record(node)
+				util.assert_userdata_type(node, "ltreesitter.Node")
+				table.insert(visited, node:source())
+			end
+			tree:walk{ call_expression = record, identifier = record }
+			assert.are.same(expected, visited)
+		end)
+		it("should call leave after walking the children", function()
+			local events = {}
+			p:parse_string(src):walk{
+				function_definition = {
+					enter = function() table.insert(events, "enter") end,
+					leave = function() table.insert(events, "leave") end,
+				},
+				return_statement = function() table.insert(events, "return") end,
+			}
+			assert.are.same({ "enter", "return", "leave", "enter", "return", "leave" }, events)
+		end)
+		it("should skip the children of nodes whose enter returns false", function()
+			local calls = 0
+			p:parse_string(src):walk{
+				call_expression = function()
+					calls = calls + 1
+					return false
+				end,
+			}
+			assert.are.equal(1, calls)
+		end)
+		it("should not call leave for nodes whose enter returns false", function()
+			local events = {}
+			p:parse_string(src):walk{
+				function_definition = {
+					enter = function(node)
+						local name = node:child_by_field_name("declarator"):child_by_field_name("declarator"):source()
+						table.insert(events, "enter " .. name)
+						return name ~= "add"
+					end,
+					leave = function() table.insert(events, "leave") end,
+				},
+			}
+			assert.are.same({ "enter add", "enter main", "leave" }, events)
+		end)
+		it("should only walk the given node when asked to", function()
+			local tree = p:parse_string(src)
+			local names = {}
+			tree:walk({ identifier = function(n) table.insert(names, n:source()) end }, { node = tree:root():child(0) })
+			assert.are.same({ "add", "a", "b", "a", "b" }, names)
+		end)
+		it("should pass over nodes with a type in options.skip and their descendants", function()
+			local tree = p:parse_string(src)
+			local names = {}
+			local record = function(n) table.insert(names, n:source()) end
+			tree:walk({ identifier = record, compound_statement = record }, { skip = "compound_statement" })
+			assert.are.same({ "add", "a", "b", "main" }, names)
+
+			names = {}
+			tree:walk({ identifier = record }, { skip = lang:symbol_set{ "parameter_list", "compound_statement" } })
+			assert.are.same({ "add", "main" }, names)
+		end)
+		it("should error on unknown node types", function()
+			assert.has.errors(function()
+				t:walk{ not_a_node_type = function() end }
+			end)
+		end)
+	end)
+	describe("node handles", function()
+		local function count_nodes(node)
+			local n = 1
+			for child in node:children() do
+				n = n + count_nodes(child)
+			end
+			return n
+		end
+		it("should walk the same nodes as regular nodes", function()
+			local tree = p:parse_string[[ int main(void) { int x = 1; return x; } ]]
+			local function count_handles(h)
+				local n = 1
+				local child = tree:handle_child(h, 0)
+				while child do
+					n = n + count_handles(child)
+					child = tree:handle_next_sibling(child)
+				end
+				return n
+			end
+			assert.are.equal(count_nodes(tree:root()), count_handles(tree:root_handle()))
+		end)
+		it("should be convertible to Nodes", function()
+			local tree = p:parse_string[[ int x = 1; ]]
+			local decl = tree:handle_child(tree:root_handle(), 0)
+			local node = util.assert_userdata_type(tree:handle_node(decl), "ltreesitter.Node")
+			assert.are.equal(node, tree:root():child(0))
+			assert.are.equal(tree:handle_type(decl), "declaration")
+			assert.are.equal(tree:handle_source(decl), "int x = 1;")
+			assert.are.same({ 1, 11 }, { tree:handle_byte_range(decl) })
+		end)
+		it("should reuse the handle of a node that already has one", function()
+			local tree = p:parse_string[[ int main(void) { int x = 1; return x; } ]]
+			local function collect(h, out)
+				table.insert(out, h)
+				local child = tree:handle_child(h, 0)
+				while child do
+					assert.are.equal(h, tree:handle_parent(child))
+					collect(child, out)
+					child = tree:handle_next_sibling(child)
+				end
+				return out
+			end
+			local first = collect(tree:root_handle(), {})
+			assert.are.same(first, collect(tree:root_handle(), {}))
+			-- every node got exactly one handle, so the arena holds no more than the tree's nodes
+			local seen = {}
+			for _, h in ipairs(first) do
+				assert.is["nil"](seen[h])
+				seen[h] = true
+				assert.is.truthy(h < #first)
+			end
+		end)
+		it("should be invalidated by release_handles", function()
+			local tree = p:parse_string[[ int x = 1; ]]
+			local root = tree:root_handle()
+			tree:release_handles()
+			assert.has.errors(function() tree:handle_type(root) end)
+		end)
+	end)
 end)